@@ -10,12 +10,39 @@
 #include "app.h"
 #include "utils.h"
 #include "ev3eyes.h"
+#include "balance.h"
+#include "recorder.h"
+#include "gun.h"
+#include "odometry.h"
+#include "watchdog.h"
+#include "remote.h"
+#include "gains.h"
+#include "period.h"
 
 #define USE_FACES
-#define FIRE_TURNS 15
 
 #define DEBUG
 
+/**
+ * Record every balance_step to RECORDER_PATH on the SD card for tools/replay.
+ */
+//#define RECORD_BALANCE
+
+/**
+ * Take commands and send telemetry over Bluetooth (remote.h, tools/btlink).
+ */
+#define USE_REMOTE_LINK
+
+/**
+ * Time the gyro and balance_step at the start of each run and shorten the
+ * control period to what they allow (period.h).
+ */
+#define ADAPTIVE_PERIOD
+
+#if defined(USE_LQR_CONTROLLER) || defined(USE_SCHEDULED_CONTROLLER)
+#undef ADAPTIVE_PERIOD  // their gains are for WAIT_TIME_MS (balance.c)
+#endif
+
 #ifdef DEBUG
 #define _debug(x) (x)
 #else
@@ -23,8 +50,8 @@
 #endif
 
 #ifdef USE_FACES
-#define DRAW_EYES(idx)               draw_eyes(idx)
-#define DRAW_EYES_AFTER_MS(idx, ms)  draw_eyes_after_ms(idx, ms)
+#define DRAW_EYES(idx)               do { if (load_level < LOAD_NO_EYES) draw_eyes(idx); } while (0)
+#define DRAW_EYES_AFTER_MS(idx, ms)  do { if (load_level < LOAD_NO_EYES) draw_eyes_after_ms(idx, ms); } while (0)
 #else
 #define DRAW_EYES(idx)
 #define DRAW_EYES_AFTER_MS(idx, ms)
@@ -54,215 +81,32 @@ const int left_motor = EV3_PORT_A;
 const int right_motor = EV3_PORT_D;
 const int gun_motor = EV3_PORT_C;
 
-/**
- * Constants for the self-balance control algorithm. (Gyrohunter version)
- */
-const float KSTEER=-0.25;
-const float EMAOFFSET = 0.0005f;
-      float KGYROANGLE = 6.0f; // 7.5f
-      float KGYROSPEED = 1.4f; // 1.15f
-      float KPOS = 0.035f; // 0.07f;
-      float KSPEED = 0.1f;
-const float KDRIVE = -0.02f;
-const float WHEEL_DIAMETER = 5.6;
-const uint32_t WAIT_TIME_MS = 5;
-const uint32_t FALL_TIME_MS = 1000;
-const float INIT_GYROANGLE = -0.25;
-const float INIT_INTERVAL_TIME = 0.014;
-
-/**
- * Constants for the self-balance control algorithm. (Original)
- */
-//const float KSTEER=-0.25;
-//const float EMAOFFSET = 0.0005f;
-//const float KGYROANGLE = 7.5f;
-//const float KGYROSPEED = 1.15f;
-//const float KPOS = 0.07f;
-//const float KSPEED = 0.1f;
-//const float KDRIVE = -0.02f;
-//const float WHEEL_DIAMETER = 5.6;
-//const uint32_t WAIT_TIME_MS = 5;
-//const uint32_t FALL_TIME_MS = 1000;
-//const float INIT_GYROANGLE = -0.25;
-//const float INIT_INTERVAL_TIME = 0.014;
-
-/**
- * Constants for the self-balance control algorithm. (Gyroboy Version)
- */
-//const float EMAOFFSET = 0.0005f;
-//const float KGYROANGLE = 15.0f;
-//const float KGYROSPEED = 0.8f;
-//const float KPOS = 0.12f;
-//const float KSPEED = 0.08f;
-//const float KDRIVE = -0.01f;
-//const float WHEEL_DIAMETER = 5.6;
-//const uint32_t WAIT_TIME_MS = 1;
-//const uint32_t FALL_TIME_MS = 1000;
-//const float INIT_GYROANGLE = -0.25;
-//const float INIT_INTERVAL_TIME = 0.014;
-
-/**
- * Global variables used by the self-balance control algorithm.
- */
-static int motor_diff, motor_diff_target;
-static int loop_count, motor_control_drive, motor_control_steer;
-static float gyro_offset, gyro_speed, gyro_angle, interval_time;
-static float motor_pos, motor_speed;
-
-/**
- * Calculate the initial gyro offset for calibration.
- */
-static ER calibrate_gyro_sensor() {
-    int min_rate = 1000, max_rate = -100, gSum = 0;
-    for (int i = 0; i < 200; ++i) {
-        int gyro = ev3_gyro_sensor_get_rate(gyro_sensor);
-        gSum += gyro;
-        if (gyro > max_rate)
-            max_rate = gyro;
-        if (gyro < min_rate)
-            min_rate = gyro;
-        tslp_tsk(4);
-    }
-    if(max_rate - min_rate < 2) {
-        gyro_offset = gSum / 200.0f;
-        return E_OK;
-    } else {
-        return E_OBJ;
-    }
-}
-
-/**
- * Calculate the average interval time of the main loop for the self-balance control algorithm.
- * Units: seconds
- */
-static void update_interval_time() {
-    static SYSTIM start_time;
-
-    if(loop_count++ == 0) { // Interval time for the first iteration (use INIT_INTERVAL_TIME)
-        interval_time = INIT_INTERVAL_TIME;
-        ER ercd = get_tim(&start_time);
-        assert(ercd == E_OK);
-    } else {
-        SYSTIM now;
-        ER ercd = get_tim(&now);
-        assert(ercd == E_OK);
-        interval_time = ((float)(now - start_time)) / loop_count / 1000;
-    }
-}
-
-/**
- * Update data of the gyro sensor.
- * gyro_offset: the offset for calibration.
- * gyro_speed: the speed of the gyro sensor after calibration.
- * gyro_angle: the angle of the robot.
- */
-static void update_gyro_data() {
-    int gyro = ev3_gyro_sensor_get_rate(gyro_sensor);
-    gyro_offset = EMAOFFSET * gyro + (1 - EMAOFFSET) * gyro_offset;
-    gyro_speed = gyro - gyro_offset;
-    gyro_angle += gyro_speed * interval_time;
-}
-
-/**
- * Update data of the motors
- */
-static void update_motor_data() {
-    static int32_t prev_motor_cnt_sum, motor_cnt_deltas[4];
-
-    if(loop_count == 1) { // Reset
-        motor_pos = 0;
-        prev_motor_cnt_sum = 0;
-        motor_cnt_deltas[0] = motor_cnt_deltas[1] = motor_cnt_deltas[2] = motor_cnt_deltas[3] = 0;
-    }
-
-    int32_t left_cnt = ev3_motor_get_counts(left_motor);
-    int32_t right_cnt = ev3_motor_get_counts(right_motor);
-    int32_t motor_cnt_sum = left_cnt + right_cnt;
-    motor_diff = right_cnt - left_cnt; // TODO: with diff
-    int32_t motor_cnt_delta = motor_cnt_sum - prev_motor_cnt_sum;
-
-    prev_motor_cnt_sum = motor_cnt_sum;
-    motor_pos += motor_cnt_delta;
-    motor_cnt_deltas[loop_count % 4] = motor_cnt_delta;
-    motor_speed = (motor_cnt_deltas[0] + motor_cnt_deltas[1] + motor_cnt_deltas[2] + motor_cnt_deltas[3]) / 4.0f / interval_time;
-}
-
-float calculate_battery_gain() {
-    const int kMaxBattery = 8500;
-    const int kMinBattery = 6500;
-    
-    int batt = ev3_battery_voltage_mV();
-    return 0.7 + ((1.12 - 0.7) / (kMaxBattery - kMinBattery)) * (kMaxBattery - batt);
-}
-
-/**
- * Control the power to keep balance.
- * Return false when the robot has fallen.
- */
-static bool_t keep_balance() {
-    static SYSTIM ok_time;
-
-    if(loop_count == 1) // Reset ok_time
-        get_tim(&ok_time);
-
-    float ratio_wheel = WHEEL_DIAMETER / 5.6;
-
-    // Apply the drive control value to the motor position to get robot to move.
-    motor_pos -= motor_control_drive * interval_time;
-
-    // This is the main balancing equation
-    int power = (int)(((KGYROSPEED * gyro_speed +                // Deg/Sec from Gyro sensor
-                        KGYROANGLE * gyro_angle) / ratio_wheel + // Deg from integral of gyro
-                        KPOS       * motor_pos +                 // From MotorRotationCount of both motors
-                        KSPEED     * motor_speed  +              // Motor speed in Deg/Sec
-                        KDRIVE     * motor_control_drive)        // To improve start/stop performance
-                      * calculate_battery_gain());               // To have a more reliable motor output across diff battery voltages
-
-    // Check fallen
-    SYSTIM time;
-    get_tim(&time);
-    if(power > -100 && power < 100)
-        ok_time = time;
-    else if(time - ok_time >= FALL_TIME_MS)
-        return false;
-
-    // Steering control
-    motor_diff_target += motor_control_steer * interval_time;
-
-    int left_power, right_power;
-
-    // TODO: support steering and motor_control_drive
-    int power_steer = (int)(KSTEER * (motor_diff_target - motor_diff));
-    left_power = power + power_steer;
-    right_power = power - power_steer;
-    if(left_power > 100)
-        left_power = 100;
-    if(left_power < -100)
-        left_power = -100;
-    if(right_power > 100)
-        right_power = 100;
-    if(right_power < -100)
-        right_power = -100;
-
-    ev3_motor_set_power(left_motor, (int)left_power);
-    ev3_motor_set_power(right_motor, (int)right_power);
-
-    return true;
-}
-
 void balance_task(intptr_t unused) {
     ER ercd;
 
     /**
      * Reset
      */
-    loop_count = 0;
-    motor_control_drive = 0;
+    balance_reset();
+    gun_reset();
     ev3_motor_reset_counts(left_motor);
     ev3_motor_reset_counts(right_motor);
     //TODO: reset the gyro sensor
     ev3_gyro_sensor_reset(gyro_sensor);
 
+#ifdef TUNABLE_GAINS
+    /**
+     * Start from the saved gains, once. A restart after a knock out keeps the ones being tuned.
+     */
+    static bool_t gains_loaded = false;
+    if (!gains_loaded) {
+        gains_init();
+        if (gains_load())
+            syslog(LOG_NOTICE, "Gains: slot %c from %s.", 'A' + gains_active(), GAINS_PATH);
+        gains_loaded = true;
+    }
+#endif
+
     gyrohunter_status = CALIB_STATUS;
     
     /**
@@ -285,35 +129,65 @@ void balance_task(intptr_t unused) {
         }
     }
     _debug(syslog(LOG_INFO, "Calibration succeed, offset is %de-3.", (int)(gyro_offset * 1000)));
-    gyro_angle = INIT_GYROANGLE;
+    balance_start();
+#ifdef ADAPTIVE_PERIOD
+    period_reset();
+#endif
+    watchdog_reset();
     ev3_led_set_color(LED_GREEN);
 
+#ifdef RECORD_BALANCE
+    recorder_start(gyro_offset);
+#endif
+
     gyrohunter_status = RUNNING_STATUS;
+    gun_arm();
     
     /**
      * Main loop for the self-balance control algorithm
      */
     while(1) {
-        // Update the interval time
-        update_interval_time();
+        SYSTIM now;
+        ercd = get_tim(&now);
+        assert(ercd == E_OK);
+        watchdog_tick(now);
+#ifdef TUNABLE_GAINS
+        bool_t gains_changed = gains_tick();
+#ifdef RECORD_BALANCE
+        if (gains_changed)
+            recorder_gains();
+#endif
+#endif
 
-        // Update data of the gyro sensor
-        update_gyro_data();
+#ifdef ADAPTIVE_PERIOD
+        SYSUTM step_start, step_end;
+        get_utm(&step_start);
+        bool_t ok = balance_step();
+        get_utm(&step_end);
+        period_step_done(step_end - step_start);
+#else
+        bool_t ok = balance_step();
+#endif
 
-        // Update data of the motors
-        update_motor_data();
+#ifdef RECORD_BALANCE
+        recorder_push(balance_last_record());
+#endif
 
-        // Keep balance
-        if(!keep_balance()) {
+        if(!ok) {
             ev3_motor_stop(left_motor, false);
             ev3_motor_stop(right_motor, false);
+            gun_reset();
             ev3_led_set_color(LED_RED); // TODO: knock out
             syslog(LOG_NOTICE, "Knock out!");
             gyrohunter_status = KNOCK_OUT_STATUS;
             return;
         }
 
-        tslp_tsk(WAIT_TIME_MS);
+#ifdef ADAPTIVE_PERIOD
+        if (period_probe(step_start + (balance_period_ms + STEP_TIME_MS) * 1000))
+            continue;
+#endif
+        tslp_tsk(balance_period_ms);
     }
 }
 
@@ -335,7 +209,20 @@ static void button_clicked_handler(intptr_t button) {
     }
 }
 
-//static FILE *bt = NULL;
+void serial_task(intptr_t unused) {
+    while(1) {
+        if (!ev3_bluetooth_is_connected() || !remote_receive())
+            tslp_tsk(100);
+    }
+}
+
+void record_task(intptr_t unused) {
+    while(1) {
+        if (load_level < LOAD_NO_TELEMETRY)
+            recorder_flush();
+        tslp_tsk(100);
+    }
+}
 
 void idle_task(intptr_t unused) {
     while(1) {
@@ -344,6 +231,7 @@ void idle_task(intptr_t unused) {
     }
 }
 
+#ifdef TUNABLE_GAINS
 // KGYROANGLE = 7.5f;   .1
 // KGYROSPEED = 1.15f;  .01
 // KPOS       = 0.07f;  .005
@@ -366,48 +254,56 @@ void update_kparameters() {
     if (now - last_ir_time < 250) return; // don't overflow with lots of cmds
     
     ir_remote_t val = ev3_infrared_sensor_get_remote(ir_sensor);
+    gain_vector_t v;
+    gains_get(gains_active(), &v);
     if (val.channel[k1_chn] & IR_RED_UP_BUTTON   ) { // inc KGYROANGLE
-        KGYROANGLE += KGYROANGLE_INC;
+        v.kgyroangle += KGYROANGLE_INC;
     }
     if (val.channel[k1_chn] & IR_RED_DOWN_BUTTON ) { // dec KGYROANGLE
-        KGYROANGLE -= KGYROANGLE_INC;
+        v.kgyroangle -= KGYROANGLE_INC;
     }
     if (val.channel[k1_chn] & IR_BLUE_UP_BUTTON  ) { // inc KGYROSPEED
-        KGYROSPEED += KGYROSPEED_INC;
+        v.kgyrospeed += KGYROSPEED_INC;
     }
     if (val.channel[k1_chn] & IR_BLUE_DOWN_BUTTON) { // dec KGYROSPEED
-        KGYROSPEED -= KGYROSPEED_INC;
+        v.kgyrospeed -= KGYROSPEED_INC;
     }
     if (val.channel[k2_chn] & IR_RED_UP_BUTTON   ) { // inc KPOS
-        KPOS += KPOS_INC;
+        v.kpos += KPOS_INC;
     }
     if (val.channel[k2_chn] & IR_RED_DOWN_BUTTON ) { // dec KPOS
-        KPOS -= KPOS_INC;
+        v.kpos -= KPOS_INC;
     }
     if (val.channel[k2_chn] & IR_BLUE_UP_BUTTON  ) { // inc KSPEED
-        KSPEED += KSPEED_INC;
+        v.kspeed += KSPEED_INC;
     }
     if (val.channel[k2_chn] & IR_BLUE_DOWN_BUTTON) { // dec KSPEED
-        KSPEED -= KSPEED_INC;
+        v.kspeed -= KSPEED_INC;
     }
     
-    if (last_ir_time == 0 ||
-        val.channel[k1_chn] || val.channel[k2_chn]) {
+    // The whole vector goes to balance_task at once; try again next time if it is busy
+    if (((val.channel[k1_chn] || val.channel[k2_chn]) && gains_set(gains_active(), &v))
+        || last_ir_time == 0) {
         ercd = get_tim(&last_ir_time);
         assert(ercd == E_OK);
     
         char lcdstr[100];
-        sprintf(lcdstr, "GYANG: %1.3f", KGYROANGLE);
+        sprintf(lcdstr, "GYANG: %1.3f", v.kgyroangle);
         print(1, lcdstr);
-        sprintf(lcdstr, "GYSPD: %1.4f", KGYROSPEED);
+        sprintf(lcdstr, "GYSPD: %1.4f", v.kgyrospeed);
         print(2, lcdstr);
-        sprintf(lcdstr, "KPOS : %1.5f", KPOS);
+        sprintf(lcdstr, "KPOS : %1.5f", v.kpos);
         print(3, lcdstr);
-        sprintf(lcdstr, "KSPD : %1.4f", KSPEED);
+        sprintf(lcdstr, "KSPD : %1.4f", v.kspeed);
         print(4, lcdstr);
     }
 }
 
+#endif
+
+#define IR_POLL_MS       100
+#define IR_SLOW_POLL_MS  300  // when the watchdog sheds load
+
 uint8_t get_ir_control() {
     static SYSTIM last_ir_time = 0;
     const int control_chn = 0;
@@ -422,7 +318,8 @@ uint8_t get_ir_control() {
         SYSTIM now;
         ercd = get_tim(&now);
         assert(ercd == E_OK);
-        if (now - last_ir_time < 100) return 1; // don't overflow with lots of cmds
+        int poll_ms = load_level >= LOAD_SLOW_IR ? IR_SLOW_POLL_MS : IR_POLL_MS;
+        if (now - last_ir_time < poll_ms) return 1; // don't overflow with lots of cmds
     }
     
     uint8_t result = 0;
@@ -449,14 +346,58 @@ uint8_t get_ir_control() {
     return result;
 }
 
-#define MAX_SPEED 600
-#define MAX_STEER 170
 #define SPEED_INC 50
 #define STEER_INC 85
 
+/**
+ * Drive commands. Each direction is +1/-1 to step the setpoint that way, or 0 to reset it.
+ * Stepping against the current setpoint resets it to 0 first.
+ */
+typedef struct {
+    uint8_t key;
+    int8_t drive;   // +1 forward, -1 backward
+    int8_t steer;   // +1 left, -1 right
+    int8_t eyes;
+    char* status;
+} drive_command_t;
+
+static const drive_command_t drive_commands[] = {
+    { 'w',  1,  0, EV3EYE_NEUTRAL,      "FWD" }, // forward
+    { 's', -1,  0, EV3EYE_NEUTRAL,      "BCK" }, // backward
+    { 'a',  0,  1, EV3EYE_MIDDLE_LEFT,  "LFT" }, // left
+    { 'd',  0, -1, EV3EYE_MIDDLE_RIGHT, "RGT" }, // right
+    { 'q',  1,  1, EV3EYE_MIDDLE_LEFT,  "LFW" }, // left forward
+    { 'e',  1, -1, EV3EYE_MIDDLE_RIGHT, "RFW" }, // right forward
+    { 'z', -1,  1, EV3EYE_MIDDLE_LEFT,  "LBK" }, // left backward
+    { 'c', -1, -1, EV3EYE_MIDDLE_RIGHT, "RBK" }, // right backward
+};
+
+static const drive_command_t* find_drive_command(uint8_t key) {
+    for (int i = 0; i < sizeof(drive_commands) / sizeof(drive_commands[0]); i++) {
+        if (drive_commands[i].key == key)
+            return &drive_commands[i];
+    }
+    return NULL;
+}
+
+static int step_setpoint(int value, int dir, int inc, int limit) {
+    if (dir == 0 || value * dir < 0)
+        return 0;
+    if (value * dir < limit)
+        return value + dir * inc;
+    return value;
+}
+
+static void apply_drive_command(const drive_command_t* cmd) {
+    // Turning against the current wheel differential is limited to half the steer range
+    int steer_limit = (motor_diff * cmd->steer >= 0) ? MAX_STEER : MAX_STEER/2;
+
+    DRAW_EYES(cmd->eyes);
+    drive_target = step_setpoint(drive_target, cmd->drive, SPEED_INC, MAX_SPEED);
+    steer_target = step_setpoint(steer_target, cmd->steer, STEER_INC, steer_limit);
+}
+
 void main_task(intptr_t unused) {
-    static SYSTIM last_gun_time = 0;
-    
 #ifndef USE_FACES
     // Draw information
     lcdfont_t font = EV3_FONT_MEDIUM;
@@ -496,9 +437,18 @@ void main_task(intptr_t unused) {
     // Start task for self-balancing
     act_tsk(BALANCE_TASK);
 
-    // Open Bluetooth file
-    //bt = ev3_serial_open_file(EV3_SERIAL_BT);
-    //assert(bt != NULL);
+#ifdef RECORD_BALANCE
+    // Start task for writing balance records to the SD card
+    act_tsk(RECORD_TASK);
+#endif
+
+#ifdef USE_REMOTE_LINK
+    // Open Bluetooth file and start task for buffering the commands
+    FILE* bt = ev3_serial_open_file(EV3_SERIAL_BT);
+    assert(bt != NULL);
+    remote_open(bt, bt);
+    act_tsk(SERIAL_TASK);
+#endif
 
     // Start task for printing message while idle
     act_tsk(IDLE_TASK);
@@ -524,13 +474,20 @@ void main_task(intptr_t unused) {
     
     // go forward a bit
     tslp_tsk(1000);
-    motor_control_drive = 100;
+    drive_target = 100;
     tslp_tsk(2000);
-    motor_control_drive = 0;
+    drive_target = 0;
 
     while(1) {
+        gun_update();
+#ifdef USE_REMOTE_LINK
+        remote_poll(gyrohunter_status);
+#endif
+
 #ifndef USE_FACES
+#ifdef TUNABLE_GAINS
         update_kparameters();
+#endif
 #else
         if (gyrohunter_status == KNOCK_OUT_STATUS)
         {
@@ -548,16 +505,16 @@ void main_task(intptr_t unused) {
 #endif
         
         char* status = "IDL";
-        //while (!ev3_bluetooth_is_connected()) tslp_tsk(100);
-        //uint8_t c = fgetc(bt);
         uint8_t c = get_ir_control();
         sus_tsk(IDLE_TASK);
         switch(c) {
         case 0:
             tslp_tsk(10);
             //ev3_lcd_draw_string("IDL", 0, fonth * 5);
-            motor_control_drive = 0;
-            motor_control_steer = 0;
+            if (!remote_in_control()) {
+                drive_target = 0;
+                steer_target = 0;
+            }
             status = "IDL";
             DRAW_EYES_AFTER_MS(EV3EYE_AWAKE, 1200);
             break;
@@ -570,127 +527,12 @@ void main_task(intptr_t unused) {
 
         case 'f':
         case 'g':
-            {
-                SYSTIM now;
-                ER ercd = get_tim(&now);
-                assert(ercd == E_OK);
-                if (now - last_gun_time > 2000) {
-                    DRAW_EYES(EV3EYE_EVIL);
-                    ev3_motor_reset_counts(gun_motor);
-                    if (c == 'f')
-                        ev3_motor_rotate(gun_motor, FIRE_TURNS*360, 100, false);
-                    else
-                        ev3_motor_rotate(gun_motor, -FIRE_TURNS*360, 100, false);
-                    status = "GUN";
-                    get_tim(&last_gun_time);
-                }
+            if (gun_fire(c == 'f' ? 1 : -1)) {
+                DRAW_EYES(EV3EYE_EVIL);
+                status = "GUN";
             }
             break;
 
-        case 'w': // forward
-            DRAW_EYES(EV3EYE_NEUTRAL);
-            if (motor_control_drive < 0)
-                motor_control_drive = 0;
-            else if (motor_control_drive < MAX_SPEED)
-                motor_control_drive += SPEED_INC;
-            motor_control_steer = 0;
-            status = "FWD";
-            break;
-
-        case 's': // backward
-            DRAW_EYES(EV3EYE_NEUTRAL);
-            if (motor_control_drive > 0)
-                motor_control_drive = 0;
-            else if (motor_control_drive > -MAX_SPEED)
-                motor_control_drive -= SPEED_INC;
-            motor_control_steer = 0;
-            status = "BCK";
-            break;
-
-        case 'a': // left
-            DRAW_EYES(EV3EYE_MIDDLE_LEFT);
-            if (motor_control_steer < 0)
-                motor_control_steer = 0;
-            else if (motor_diff >= 0 && motor_control_steer < MAX_STEER)
-                motor_control_steer += STEER_INC;
-            else if (motor_diff < 0 && motor_control_steer < MAX_STEER/2)
-                motor_control_steer += STEER_INC;
-            motor_control_drive = 0;
-            status = "LFT";
-            break;
-
-        case 'd': // right
-            DRAW_EYES(EV3EYE_MIDDLE_RIGHT);
-            if (motor_control_steer > 0)
-                motor_control_steer = 0;
-            else if (motor_diff <= 0 && motor_control_steer > -MAX_STEER)
-                motor_control_steer -= STEER_INC;
-            else if (motor_diff > 0 && motor_control_steer > -MAX_STEER/2)
-                motor_control_steer -= STEER_INC;
-            motor_control_drive = 0;
-            status = "RGT";
-            break;
-
-        case 'q': // left forward
-            DRAW_EYES(EV3EYE_MIDDLE_LEFT);
-            if (motor_control_steer < 0)
-                motor_control_steer = 0;
-            else if (motor_diff >= 0 && motor_control_steer < MAX_STEER)
-                motor_control_steer += STEER_INC;
-            else if (motor_diff < 0 && motor_control_steer < MAX_STEER/2)
-                motor_control_steer += STEER_INC;
-            if (motor_control_drive < 0)
-                motor_control_drive = 0;
-            else if (motor_control_drive < MAX_SPEED)
-                motor_control_drive += SPEED_INC;
-            status = "LFW";
-            break;
-
-        case 'e': // right forward
-            DRAW_EYES(EV3EYE_MIDDLE_RIGHT);
-            if (motor_control_steer > 0)
-                motor_control_steer = 0;
-            else if (motor_diff <= 0 && motor_control_steer > -MAX_STEER)
-                motor_control_steer -= STEER_INC;
-            else if (motor_diff > 0 && motor_control_steer > -MAX_STEER/2)
-                motor_control_steer -= STEER_INC;
-            if (motor_control_drive < 0)
-                motor_control_drive = 0;
-            else if (motor_control_drive < MAX_SPEED)
-                motor_control_drive += SPEED_INC;
-            status = "RFW";
-            break;
-
-        case 'z': // left backward
-            DRAW_EYES(EV3EYE_MIDDLE_LEFT);
-            if (motor_control_steer < 0)
-                motor_control_steer = 0;
-            else if (motor_diff >= 0 && motor_control_steer < MAX_STEER)
-                motor_control_steer += STEER_INC;
-            else if (motor_diff < 0 && motor_control_steer < MAX_STEER/2)
-                motor_control_steer += STEER_INC;
-            if (motor_control_drive > 0)
-                motor_control_drive = 0;
-            else if (motor_control_drive > -MAX_SPEED)
-                motor_control_drive -= 50;
-            status = "LBK";
-            break;
-
-        case 'c': // right backward
-            DRAW_EYES(EV3EYE_MIDDLE_RIGHT);
-            if (motor_control_steer > 0)
-                motor_control_steer = 0;
-            else if (motor_diff <= 0 && motor_control_steer > -MAX_STEER)
-                motor_control_steer -= STEER_INC;
-            else if (motor_diff > 0 && motor_control_steer > -MAX_STEER/2)
-                motor_control_steer -= STEER_INC;
-            if(motor_control_drive > 0)
-                motor_control_drive = 0;
-            else if (motor_control_drive > -MAX_SPEED)
-                motor_control_drive -= SPEED_INC;
-            status = "RBK";
-            break;
-
         case 'h':
             //fprintf(bt, "==========================\n");
             //fprintf(bt, "Usage:\n");
@@ -710,17 +552,29 @@ void main_task(intptr_t unused) {
             break;
 
         default:
+            {
+                const drive_command_t* cmd = find_drive_command(c);
+                if (cmd != NULL) {
+                    apply_drive_command(cmd);
+                    status = cmd->status;
+                    break;
+                }
+            }
             //fprintf(bt, "Unknown key '%c' pressed.\n", c);
             tslp_tsk(10);
         }
         
 #ifndef USE_FACES
-        sprintf(lcdstr, "%s D:%d S:%d", status, motor_control_drive, motor_control_steer);
-        print(5, lcdstr);
-        sprintf(lcdstr, "%d mV", ev3_battery_voltage_mV());
-        print(6, lcdstr);
-        //sprintf(lcdstr, "%d %d %d", motor_diff, motor_diff_target, (motor_diff_target - motor_diff));
-        //print(7, lcdstr);
+        if (load_level < LOAD_NO_EYES) {
+            sprintf(lcdstr, "%s D:%d S:%d", status, drive_target, steer_target);
+            print(5, lcdstr);
+            sprintf(lcdstr, "%d mV", ev3_battery_voltage_mV());
+            print(6, lcdstr);
+            pose_t pose;
+            odometry_get_pose(&pose);
+            sprintf(lcdstr, "%d,%d mm %d deg", (int)ODOMETRY_MM(pose.x), (int)ODOMETRY_MM(pose.y), (int)ODOMETRY_DEG(pose.heading));
+            print(7, lcdstr);
+        }
 #endif
     }
 }
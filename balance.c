@@ -0,0 +1,473 @@
+/**
+ * Self-balance control algorithm, run by balance_task in app.c.
+ * Depends only on the ev3api calls it makes, so the host tools can run it
+ * unmodified against recorded or simulated sensors.
+ */
+
+#include <math.h>
+#include "ev3api.h"
+#include "balance.h"
+#include "profile.h"
+#include "controller.h"
+#include "odometry.h"
+#include "fall.h"
+#include "gyro.h"
+
+#ifdef TUNABLE_GAINS
+#define TUNABLE
+#elif defined(USE_LQR_CONTROLLER)
+#define TUNABLE static const __attribute__((unused))  // the LQR gains stand in for the hand-tuned ones
+#else
+#define TUNABLE static const
+#endif
+#define TUNABLE_GAIN TUNABLE float
+
+#if GAIN_PROFILE == GAIN_PROFILE_GYROHUNTER
+/**
+ * Constants for the self-balance control algorithm. (Gyrohunter version)
+ */
+const float KSTEER=-0.25;
+const float EMAOFFSET = 0.0005f;
+TUNABLE_GAIN KGYROANGLE = 6.0f; // 7.5f
+TUNABLE_GAIN KGYROSPEED = 1.4f; // 1.15f
+TUNABLE_GAIN KPOS = 0.035f; // 0.07f;
+TUNABLE_GAIN KSPEED = 0.1f;
+const float KDRIVE = -0.02f;
+const float WHEEL_DIAMETER = 5.6;
+const float TRACK_WIDTH = 12.0; // cm, between the wheel centres
+const uint32_t WAIT_TIME_MS = 5;
+const uint32_t FALL_TIME_MS = 1000;
+const float INIT_GYROANGLE = -0.25;
+const float INIT_INTERVAL_TIME = 0.014;
+
+#elif GAIN_PROFILE == GAIN_PROFILE_ORIGINAL
+/**
+ * Constants for the self-balance control algorithm. (Original)
+ */
+const float KSTEER=-0.25;
+const float EMAOFFSET = 0.0005f;
+TUNABLE_GAIN KGYROANGLE = 7.5f;
+TUNABLE_GAIN KGYROSPEED = 1.15f;
+TUNABLE_GAIN KPOS = 0.07f;
+TUNABLE_GAIN KSPEED = 0.1f;
+const float KDRIVE = -0.02f;
+const float WHEEL_DIAMETER = 5.6;
+const float TRACK_WIDTH = 12.0; // cm, between the wheel centres
+const uint32_t WAIT_TIME_MS = 5;
+const uint32_t FALL_TIME_MS = 1000;
+const float INIT_GYROANGLE = -0.25;
+const float INIT_INTERVAL_TIME = 0.014;
+
+#elif GAIN_PROFILE == GAIN_PROFILE_GYROBOY
+/**
+ * Constants for the self-balance control algorithm. (Gyroboy Version)
+ */
+const float KSTEER=-0.25;
+const float EMAOFFSET = 0.0005f;
+TUNABLE_GAIN KGYROANGLE = 15.0f;
+TUNABLE_GAIN KGYROSPEED = 0.8f;
+TUNABLE_GAIN KPOS = 0.12f;
+TUNABLE_GAIN KSPEED = 0.08f;
+const float KDRIVE = -0.01f;
+const float WHEEL_DIAMETER = 5.6;
+const float TRACK_WIDTH = 12.0; // cm, between the wheel centres
+const uint32_t WAIT_TIME_MS = 1;
+const uint32_t FALL_TIME_MS = 1000;
+const float INIT_GYROANGLE = -0.25;
+const float INIT_INTERVAL_TIME = 0.014;
+
+#else
+#error "Unknown GAIN_PROFILE"
+#endif
+
+/**
+ * Limits for the drive and steer setpoint profiles.
+ * ACCEL is the max change per second of the setpoint, JERK the max change per second of that rate.
+ */
+const float DRIVE_ACCEL = 1200.0f; // 0 to MAX_SPEED in 0.5 s
+const float DRIVE_JERK = 8000.0f;
+const float STEER_ACCEL = 1000.0f;
+const float STEER_JERK = 8000.0f;
+
+/**
+ * Heading control. A PI loop on the encoder differential makes motor_diff
+ * follow motor_diff_target, which integrates the steer setpoint. KSTEER (in
+ * the gain profile) is the proportional gain; the integral, in count-seconds,
+ * is limited to STEER_I_LIMIT of power so it cannot wind up while a wheel is
+ * blocked.
+ */
+const float KSTEER_I = -0.6f;
+const float STEER_I_LIMIT = 20.0f;
+
+/**
+ * Fall prediction (fall.h), from tools/fallcheck -n 4000: no false positives,
+ * and the motors are cut about 0.9 s sooner than FALL_TIME_MS alone would.
+ */
+TUNABLE fall_params_t FALL_PARAMS = { 20.0f, 0.20f, 20 };
+
+/**
+ * Gun reaction feedforward. At power 100 the gun runs at GUN_SPEED and gets
+ * there (or back to rest) with time constant GUN_TAU; the torque that
+ * accelerates it pushes the body the other way. KGUN is the power per deg/s^2
+ * of gun acceleration that cancels it, from the gun model in tools/plant.c.
+ * Flip its sign if the gun motor is mounted the other way round.
+ */
+const float GUN_SPEED = 1450.0f;
+const float GUN_TAU = 0.03f;
+TUNABLE_GAIN KGUN = -2.8e-4f;
+
+/**
+ * Control period. The gain profile is tuned for a loop of balance_step plus
+ * tslp_tsk(WAIT_TIME_MS), which takes about STEP_TIME_MS (balance.h) more.
+ * The hand-tuned gains are in physical units and interval_time follows the
+ * loop, so for another wait only the per-tick constants are rescaled: the
+ * gyro offset EMA, and the number of ticks the motor and gun speeds are
+ * averaged over, so that the filters keep their time constants. The LQR gains
+ * are a discrete design at WAIT_TIME_MS and the gain schedule was tuned
+ * there, so app.c keeps WAIT_TIME_MS with those controllers.
+ */
+#define SPEED_TAPS      4   // at WAIT_TIME_MS
+#define SPEED_TAPS_MAX  16  // power of two
+
+uint32_t balance_period_ms;
+static float ema_offset;
+static int speed_taps;
+static bool_t period_changed;
+
+/**
+ * Global variables used by the self-balance control algorithm.
+ */
+int motor_diff, motor_diff_target;
+int loop_count;
+float motor_control_drive, motor_control_steer;
+float gyro_offset, gyro_speed, gyro_angle, interval_time;
+float motor_pos, motor_speed;
+int drive_target, steer_target;
+int gun_direction;
+int32_t gun_target;
+float gun_speed, gun_power;
+
+static motion_profile_t drive_profile, steer_profile;
+static int32_t diff_target_frac;  // fraction of a count not yet in motor_diff_target, Q16
+static float steer_integral;
+static fall_detector_t fall_detector;
+static balance_record_t record;
+
+/**
+ * Calculate the initial gyro offset for calibration.
+ */
+ER calibrate_gyro_sensor() {
+    int min_rate = 1000, max_rate = -100, gSum = 0;
+    for (int i = 0; i < 200; ++i) {
+        int gyro = ev3_gyro_sensor_get_rate(gyro_sensor);
+        gSum += gyro;
+        if (gyro > max_rate)
+            max_rate = gyro;
+        if (gyro < min_rate)
+            min_rate = gyro;
+        tslp_tsk(4);
+    }
+    if(max_rate - min_rate < 2) {
+        gyro_offset = gSum / 200.0f;
+        return E_OK;
+    } else {
+        return E_OBJ;
+    }
+}
+
+/**
+ * Calculate the average interval time of the main loop for the self-balance control algorithm.
+ * Units: seconds
+ */
+static void update_interval_time(SYSTIM now) {
+    static SYSTIM start_time;
+    static int count;
+
+    if(loop_count++ == 0) { // Interval time for the first iteration (use INIT_INTERVAL_TIME)
+        interval_time = INIT_INTERVAL_TIME;
+        start_time = now;
+        count = 1;
+        period_changed = false;
+    } else if(period_changed) { // Average only the loops at the new period, starting from its nominal value
+        interval_time = (balance_period_ms + STEP_TIME_MS) / 1000.0f;
+        start_time = now;
+        count = 0;
+        period_changed = false;
+    } else {
+        interval_time = ((float)(now - start_time)) / ++count / 1000;
+    }
+}
+
+/**
+ * Update data of the gyro sensor.
+ * gyro_offset: the offset for calibration.
+ * gyro_speed: the speed of the gyro sensor after calibration.
+ * gyro_angle: the angle of the robot.
+ * A repeated sample is kept out of the offset, and the rate it holds is
+ * integrated over this interval as well.
+ */
+static void update_gyro_data() {
+    int gyro;
+    if(gyro_sample(&gyro))
+        gyro_offset = ema_offset * gyro + (1 - ema_offset) * gyro_offset;
+    else
+        record.flags |= RECORD_STALE;
+    record.gyro_rate = gyro;
+    gyro_speed = gyro - gyro_offset;
+    gyro_angle += gyro_speed * interval_time;
+}
+
+/**
+ * Update data of the motors
+ */
+static void update_motor_data() {
+    static int32_t prev_motor_cnt_sum, motor_cnt_sums[SPEED_TAPS_MAX];
+
+    int32_t left_cnt = ev3_motor_get_counts(left_motor);
+    int32_t right_cnt = ev3_motor_get_counts(right_motor);
+    record.left_cnt = left_cnt;
+    record.right_cnt = right_cnt;
+
+    if(loop_count == 1) { // Reset
+        motor_pos = 0;
+        prev_motor_cnt_sum = 0;
+        for(int i = 0; i < SPEED_TAPS_MAX; i++)
+            motor_cnt_sums[i] = 0;
+        odometry_reset(left_cnt, right_cnt);
+    }
+    odometry_update(left_cnt, right_cnt);
+
+    int32_t motor_cnt_sum = left_cnt + right_cnt;
+    motor_diff = right_cnt - left_cnt; // TODO: with diff
+    int32_t motor_cnt_delta = motor_cnt_sum - prev_motor_cnt_sum;
+
+    prev_motor_cnt_sum = motor_cnt_sum;
+    motor_pos += motor_cnt_delta;
+    // Counts over the last speed_taps ticks
+    int32_t window = motor_cnt_sum - motor_cnt_sums[(loop_count - speed_taps) & (SPEED_TAPS_MAX - 1)];
+    motor_cnt_sums[loop_count & (SPEED_TAPS_MAX - 1)] = motor_cnt_sum;
+    motor_speed = window / (float)speed_taps / interval_time;
+}
+
+/**
+ * Update data of the gun motor and the feedforward for its reaction torque.
+ * The gun acceleration is predicted from the first-order response towards
+ * the speed the burst asks for, which is smoother than differentiating the
+ * counts twice.
+ */
+static void update_gun_data() {
+    static int32_t gun_cnts[SPEED_TAPS_MAX];
+
+    int32_t cnt = ev3_motor_get_counts(gun_motor);
+    int direction = gun_direction;
+    int32_t target = gun_target;
+    record.gun_cnt = cnt;
+    record.gun_direction = direction;
+    record.gun_target = target;
+
+    if(loop_count == 1) // Reset
+        for(int i = 0; i < SPEED_TAPS_MAX; i++)
+            gun_cnts[i] = cnt;
+
+    gun_speed = (cnt - gun_cnts[(loop_count - speed_taps) & (SPEED_TAPS_MAX - 1)]) / (float)speed_taps / interval_time;
+    gun_cnts[loop_count & (SPEED_TAPS_MAX - 1)] = cnt;
+
+    float command = (direction != 0 && direction * (target - cnt) > 0) ? direction * GUN_SPEED : 0;
+    gun_power = KGUN * (command - gun_speed) / GUN_TAU;
+}
+
+float calculate_battery_gain() {
+    const int kMaxBattery = 8500;
+    const int kMinBattery = 6500;
+    
+    int batt = ev3_battery_voltage_mV();
+    record.battery_mV = batt;
+    return 0.7 + ((1.12 - 0.7) / (kMaxBattery - kMinBattery)) * (kMaxBattery - batt);
+}
+
+#if !defined(USE_LQR_CONTROLLER) && !defined(USE_SCHEDULED_CONTROLLER) || defined(BALANCE_BENCH)
+/**
+ * The hand-tuned balancing equation. tools/bench defines BALANCE_BENCH to time it with any controller.
+ */
+static float handtuned_power(const balance_state_t* x) {
+    const float ratio_wheel = WHEEL_DIAMETER / 5.6;
+
+    return (KGYROSPEED * x->gyro_speed +                // Deg/Sec from Gyro sensor
+            KGYROANGLE * x->gyro_angle) / ratio_wheel + // Deg from integral of gyro
+            KPOS       * x->motor_pos +                 // From MotorRotationCount of both motors
+            KSPEED     * x->motor_speed  +              // Motor speed in Deg/Sec
+            KDRIVE     * x->drive;                      // To improve start/stop performance
+}
+
+static const controller_t handtuned_controller = { "Hand-tuned", handtuned_power };
+#endif
+
+void balance_gains_changed() {
+#ifdef USE_SCHEDULED_CONTROLLER
+    const float ratio_wheel = WHEEL_DIAMETER / 5.6;
+    const float base[NUM_GAINS] = { KGYROSPEED / ratio_wheel, KGYROANGLE / ratio_wheel, KPOS, KSPEED, KDRIVE };
+    gain_schedule_init(base);
+#endif
+}
+
+#if defined(USE_LQR_CONTROLLER)
+static const controller_t* const controller = &lqr_controller;
+#elif defined(USE_SCHEDULED_CONTROLLER)
+static const controller_t* const controller = &scheduled_controller;
+#else
+static const controller_t* const controller = &handtuned_controller;
+#endif
+
+/**
+ * PI heading control, returns the power to add to the left wheel and take from the right.
+ */
+static int steer_power() {
+    static bool_t steering;
+
+#ifdef HEADING_HOLD
+    // Once the steer setpoint is back to 0, hold the heading the robot has rather than catch up with the target
+    if(steering && motor_control_steer == 0) {
+        motor_diff_target = motor_diff;
+        diff_target_frac = 0;
+    }
+#endif
+    steering = (motor_control_steer != 0);
+
+    // Whole counts go to motor_diff_target, the fraction carries to the next tick
+    diff_target_frac += (int32_t)(motor_control_steer * interval_time * 65536);
+    motor_diff_target += diff_target_frac >> 16;
+    diff_target_frac &= 0xffff;
+
+    int err = motor_diff_target - motor_diff;
+    steer_integral += err * interval_time;
+    float limit = STEER_I_LIMIT / fabsf(KSTEER_I);
+    if(steer_integral > limit)
+        steer_integral = limit;
+    if(steer_integral < -limit)
+        steer_integral = -limit;
+
+    return (int)(KSTEER * err + KSTEER_I * steer_integral);
+}
+
+/**
+ * Control the power to keep balance.
+ * Return false when the robot has fallen.
+ */
+static bool_t keep_balance(SYSTIM time) {
+    static SYSTIM ok_time;
+
+    if(loop_count == 1) { // Reset ok_time
+        ok_time = time;
+        fall_reset(&fall_detector, time);
+    }
+
+    // Apply the drive control value to the motor position to get robot to move.
+    motor_pos -= motor_control_drive * interval_time;
+
+    balance_state_t state = { gyro_speed, gyro_angle, motor_pos, motor_speed, motor_control_drive };
+    int power = (int)((controller->power(&state) + gun_power)    // Cancel the reaction of the gun
+                      * calculate_battery_gain());               // To have a more reliable motor output across diff battery voltages
+    record.power = power;
+
+    // Check fallen
+    if(power > -100 && power < 100)
+        ok_time = time;
+    else if(time - ok_time >= FALL_TIME_MS)
+        return false;
+    if(fall_predict(&fall_detector, &FALL_PARAMS, gyro_angle, gyro_speed, power, time))
+        return false;
+
+    // Steering control
+    int power_steer = steer_power();
+    int left_power, right_power;
+    left_power = power + power_steer;
+    right_power = power - power_steer;
+    if(left_power > 100)
+        left_power = 100;
+    if(left_power < -100)
+        left_power = -100;
+    if(right_power > 100)
+        right_power = 100;
+    if(right_power < -100)
+        right_power = -100;
+
+    ev3_motor_set_power(left_motor, (int)left_power);
+    ev3_motor_set_power(right_motor, (int)right_power);
+    record.left_power = left_power;
+    record.right_power = right_power;
+
+    return true;
+}
+
+void balance_reset() {
+    balance_set_period(WAIT_TIME_MS);
+    loop_count = 0;
+    motor_control_drive = motor_control_steer = 0;
+    motor_diff_target = 0;
+    diff_target_frac = 0;
+    steer_integral = 0;
+    drive_target = steer_target = 0;
+    profile_init(&drive_profile, DRIVE_ACCEL, DRIVE_JERK);
+    profile_init(&steer_profile, STEER_ACCEL, STEER_JERK);
+    odometry_init(WHEEL_DIAMETER, TRACK_WIDTH);
+    balance_gains_changed();
+}
+
+void balance_start() {
+    gyro_angle = INIT_GYROANGLE;
+}
+
+void balance_set_period(uint32_t wait_ms) {
+    if (wait_ms == balance_period_ms)
+        return;
+
+    // Exactly the tuned constants at WAIT_TIME_MS
+    float ratio = (float)(wait_ms + STEP_TIME_MS) / (WAIT_TIME_MS + STEP_TIME_MS);
+    int taps = (int)(SPEED_TAPS / ratio + 0.5f);
+
+    ema_offset = EMAOFFSET * ratio;
+    speed_taps = taps < 1 ? 1 : taps > SPEED_TAPS_MAX ? SPEED_TAPS_MAX : taps;
+    balance_period_ms = wait_ms;
+    period_changed = true;
+}
+
+bool_t balance_step() {
+    SYSTIM now;
+    ER ercd = get_tim(&now);
+    assert(ercd == E_OK);
+
+    record.time = now;
+    record.period_ms = balance_period_ms;
+    record.flags = 0;
+    record.left_power = record.right_power = 0;
+
+    // Update the interval time
+    update_interval_time(now);
+
+    // Update data of the gyro sensor
+    update_gyro_data();
+
+    // Update data of the motors
+    update_motor_data();
+    update_gun_data();
+
+    // Follow the drive and steer setpoints
+    record.drive_target = drive_target;
+    record.steer_target = steer_target;
+    profile_set_target(&drive_profile, record.drive_target);
+    profile_set_target(&steer_profile, record.steer_target);
+    motor_control_drive = profile_step(&drive_profile, interval_time);
+    motor_control_steer = profile_step(&steer_profile, interval_time);
+
+    // Keep balance
+    if(!keep_balance(now)) {
+        record.flags |= RECORD_FALLEN;
+        return false;
+    }
+
+    return true;
+}
+
+const balance_record_t* balance_last_record() {
+    return &record;
+}
@@ -0,0 +1,166 @@
+#ifndef __BALANCE_H__
+#define __BALANCE_H__
+
+#include "ev3api.h"
+#include "fall.h"
+
+/**
+ * Gain profiles for the self-balance control algorithm, selected at build time.
+ * Without TUNABLE_GAINS every gain is a compile-time constant, so keep_balance
+ * is folded down to constant multiplies. With TUNABLE_GAINS, KGYROANGLE,
+ * KGYROSPEED, KPOS and KSPEED live in RAM and update_kparameters can change
+ * them from the IR remote (only when USE_FACES is off, the LCD shows them).
+ */
+#define GAIN_PROFILE_GYROHUNTER 1
+#define GAIN_PROFILE_ORIGINAL   2
+#define GAIN_PROFILE_GYROBOY    3
+
+#ifndef GAIN_PROFILE
+#define GAIN_PROFILE GAIN_PROFILE_GYROHUNTER
+#endif
+
+//#define TUNABLE_GAINS
+
+/**
+ * Balance controller: the hand-tuned law in balance.c, or the LQR or speed-scheduled laws in controller.c.
+ */
+//#define USE_LQR_CONTROLLER
+//#define USE_SCHEDULED_CONTROLLER
+
+/**
+ * When steering stops, keep going straight from where the robot points
+ * rather than turning on until the wheel differential reaches its target.
+ */
+#define HEADING_HOLD
+
+#ifdef TUNABLE_GAINS
+extern float KGYROANGLE, KGYROSPEED, KPOS, KSPEED, KGUN;
+extern fall_params_t FALL_PARAMS;
+#endif
+
+extern const uint32_t WAIT_TIME_MS;
+
+/**
+ * Wait between two balance_steps, WAIT_TIME_MS unless balance_set_period changed it.
+ */
+extern uint32_t balance_period_ms;
+
+#define STEP_TIME_MS 1  // a loop takes about this much longer than its wait, as in tools/sim.c
+
+/**
+ * Ports used by the balance loop, defined in app.c.
+ */
+extern const int gyro_sensor;
+extern const int left_motor;
+extern const int right_motor;
+extern const int gun_motor;
+
+/**
+ * State of the self-balance control algorithm.
+ */
+extern int motor_diff, motor_diff_target;
+extern int loop_count;
+extern float motor_control_drive, motor_control_steer;
+extern float gyro_offset, gyro_speed, gyro_angle, interval_time;
+extern float motor_pos, motor_speed;
+
+/**
+ * Setpoints requested by main_task. balance_step follows them through the motion profiles.
+ */
+extern int drive_target, steer_target;
+
+#define MAX_SPEED 600  // drive_target limit
+#define MAX_STEER 170  // steer_target limit
+
+/**
+ * Gun burst published by the gun module (gun.c): the gun is turning towards
+ * gun_target (motor counts) in gun_direction (+1 or -1), or idle when 0.
+ * Set gun_target before gun_direction.
+ */
+extern int gun_direction;
+extern int32_t gun_target;
+
+/**
+ * Gun speed (deg/s) measured by balance_step, and the power added to cancel the gun's reaction torque.
+ */
+extern float gun_speed, gun_power;
+
+/**
+ * Everything one balance_step read from the kernel and the sensors, and the
+ * power it set. Replaying the inputs through balance_step reproduces the
+ * outputs bit for bit (see tools/replay.c).
+ */
+#define RECORD_FALLEN 0x01  // balance_step returned false, motors were not set
+#define RECORD_START  0x02  // first record of a run, gyro_offset holds the calibration
+#define RECORD_GAP    0x04  // records were dropped before this one
+#define RECORD_STALE  0x08  // the gyro sample repeated the last one (gyro.h)
+#define RECORD_GAINS  0x10  // not a tick: the TUNABLE_GAINS gains from the next tick on
+
+#define RECORD_NUM_GAINS 5  // KGYROANGLE, KGYROSPEED, KPOS, KSPEED, KGUN
+
+typedef struct {
+    uint32_t time;          // SYSTIM, ms
+    uint8_t  flags;
+    int8_t   left_power;
+    int8_t   right_power;
+    int8_t   gun_direction;
+    union {
+        struct {
+            int16_t  gyro_rate;     // deg/s
+            uint16_t battery_mV;
+            int32_t  left_cnt;      // deg
+            int32_t  right_cnt;     // deg
+            int16_t  drive_target;
+            int16_t  steer_target;
+            int32_t  gun_cnt;       // deg
+            int32_t  gun_target;    // deg
+            uint16_t period_ms;     // balance_period_ms
+            int16_t  power;         // balance power before steering and the motor limits, as fall_predict sees it
+        };
+        float gyro_offset;                  // RECORD_START only
+        float gains[RECORD_NUM_GAINS];      // RECORD_GAINS only
+    };
+} balance_record_t;
+
+/**
+ * Reset the control state before a new run.
+ */
+void balance_reset();
+
+/**
+ * Call after changing the TUNABLE_GAINS gains, so that controllers derived
+ * from them (the gain schedule) follow. balance_task only.
+ */
+void balance_gains_changed();
+
+/**
+ * Calculate the initial gyro offset. Returns E_OBJ if the robot was not still.
+ */
+ER calibrate_gyro_sensor();
+
+/**
+ * Start a run after calibration.
+ */
+void balance_start();
+
+/**
+ * Wait wait_ms between the balance_steps from now on, with the per-tick
+ * constants rescaled to match. Call between two balance_steps. Setting the
+ * period it already has changes nothing, interval_time keeps its average.
+ */
+void balance_set_period(uint32_t wait_ms);
+
+/**
+ * Run one iteration of the control loop: sensors, setpoint profiles and balance law.
+ * Return false when the robot has fallen.
+ */
+bool_t balance_step();
+
+/**
+ * Inputs and outputs of the last balance_step.
+ */
+const balance_record_t* balance_last_record();
+
+float calculate_battery_gain();
+
+#endif // __BALANCE_H__
@@ -0,0 +1,79 @@
+#include <math.h>
+#include "controller.h"
+
+/**
+ * Generated by tools/lqr_design -t 0.005 from the plant model in tools/plant.c.
+ * Regenerate after changing WAIT_TIME_MS or the robot's build.
+ *
+ * On the linear model: 3 deg tilt settles in 0.38 s, a 50 deg/s push peaks
+ * at 2.6 deg and settles in 0.56 s (Gyrohunter hand-tuned gains: 1.81 s,
+ * 2.1 deg, 1.75 s).
+ */
+static const float LQR_KGYROSPEED = 2.56482f;
+static const float LQR_KGYROANGLE = 19.90083f;
+static const float LQR_KPOS = 0.12795f;
+static const float LQR_KSPEED = 0.20164f;
+
+static float lqr_power(const balance_state_t* x) {
+    // The drive command is a reference for the wheel speed, motor_pos already tracks its integral
+    return LQR_KGYROSPEED * x->gyro_speed +
+           LQR_KGYROANGLE * x->gyro_angle +
+           LQR_KPOS       * x->motor_pos +
+           LQR_KSPEED     * (x->motor_speed - x->drive);
+}
+
+const controller_t lqr_controller = { "LQR", lqr_power };
+
+/**
+ * Speed-scheduled gains, as factors of the profile's gains. Each point is
+ * fitted on the plant model by tools/tuner -d <speed> for the Gyrohunter
+ * profile. KGYROANGLE and KPOS end on the edge of the tuner's grid.
+ */
+static gain_point_t gain_schedule[] = {
+    //  speed   KGYROSPEED KGYROANGLE KPOS     KSPEED   KDRIVE
+    {   0.0f, { 0.6733f,   3.0f,      0.3333f, 0.8462f, 1.0f } },
+    { 300.0f, { 1.1210f,   3.0f,      0.3576f, 0.9078f, 1.0f } },
+    { 600.0f, { 2.5164f,   3.0f,      0.3333f, 1.1409f, 1.0f } },
+};
+
+#define NUM_GAIN_POINTS (sizeof(gain_schedule) / sizeof(gain_schedule[0]))
+
+void gain_schedule_init(const float base[NUM_GAINS]) {
+    for (int i = 0; i < NUM_GAIN_POINTS; i++)
+        for (int j = 0; j < NUM_GAINS; j++)
+            gain_schedule[i].k[j] = gain_schedule[i].scale[j] * base[j];
+
+    for (int i = 0; i < NUM_GAIN_POINTS; i++) {
+        for (int j = 0; j < NUM_GAINS; j++) {
+            if (i + 1 < NUM_GAIN_POINTS)
+                gain_schedule[i].slope[j] = (gain_schedule[i + 1].k[j] - gain_schedule[i].k[j]) /
+                                            (gain_schedule[i + 1].speed - gain_schedule[i].speed);
+            else
+                gain_schedule[i].slope[j] = 0; // hold the last point beyond the table
+        }
+    }
+}
+
+void gain_schedule_lookup(float speed, float k[NUM_GAINS]) {
+    int i = 0;
+    while (i + 1 < NUM_GAIN_POINTS && speed >= gain_schedule[i + 1].speed)
+        i++;
+
+    const gain_point_t* p = &gain_schedule[i];
+    float ds = speed - p->speed;
+    for (int j = 0; j < NUM_GAINS; j++)
+        k[j] = p->k[j] + p->slope[j] * ds;
+}
+
+static float scheduled_power(const balance_state_t* x) {
+    float k[NUM_GAINS];
+    gain_schedule_lookup(fabsf(x->drive), k);
+
+    return k[0] * x->gyro_speed +
+           k[1] * x->gyro_angle +
+           k[2] * x->motor_pos +
+           k[3] * x->motor_speed +
+           k[4] * x->drive;
+}
+
+const controller_t scheduled_controller = { "Scheduled", scheduled_power };
@@ -0,0 +1,52 @@
+#ifndef __CONTROLLER_H__
+#define __CONTROLLER_H__
+
+/**
+ * Inputs of a balance controller, as computed by balance_task every tick.
+ */
+typedef struct {
+    float gyro_speed;   // deg/s
+    float gyro_angle;   // deg
+    float motor_pos;    // deg, sum of both encoders minus the integrated drive command
+    float motor_speed;  // deg/s, sum of both encoders
+    float drive;        // motor_control_drive
+} balance_state_t;
+
+/**
+ * A balance controller returns the motor power before the battery gain is applied.
+ */
+typedef struct {
+    const char* name;
+    float (*power)(const balance_state_t* x);
+} controller_t;
+
+/**
+ * Discrete LQR on { gyro_speed, gyro_angle, motor_pos, motor_speed },
+ * gains designed offline by tools/lqr_design.
+ */
+extern const controller_t lqr_controller;
+
+/**
+ * Gain vector { gyro_speed, gyro_angle, motor_pos, motor_speed, drive } of the linear balance law.
+ */
+#define NUM_GAINS 5
+
+typedef struct {
+    float speed;              // |motor_control_drive| this gain vector is tuned for
+    float scale[NUM_GAINS];   // times the base gains given to gain_schedule_init
+    float k[NUM_GAINS];       // set by gain_schedule_init
+    float slope[NUM_GAINS];   // change of k per unit of speed up to the next point, set by gain_schedule_init
+} gain_point_t;
+
+/**
+ * Linear law with gains interpolated on |drive| from a table sorted by speed.
+ * The table scales a base vector, the gain profile's own gains, so it follows
+ * GAIN_PROFILE and live tuning. gain_schedule_init must run before the
+ * controller is used and again whenever the base gains change.
+ */
+extern const controller_t scheduled_controller;
+
+void gain_schedule_init(const float base[NUM_GAINS]);
+void gain_schedule_lookup(float speed, float k[NUM_GAINS]);
+
+#endif // __CONTROLLER_H__
@@ -0,0 +1,18 @@
+#include "ev3api.h"
+#include "fall.h"
+
+void fall_reset(fall_detector_t* d, SYSTIM time) {
+    d->since = time;
+}
+
+bool_t fall_predict(fall_detector_t* d, const fall_params_t* p, float angle, float speed, int power, SYSTIM time) {
+    float ahead = angle + speed * p->horizon;
+    int lean = ahead > p->angle ? 1 : ahead < -p->angle ? -1 : 0;
+    int saturated = power >= 100 ? 1 : power <= -100 ? -1 : 0;
+
+    if (lean == 0 || saturated != lean) {
+        d->since = time;
+        return false;
+    }
+    return time - d->since >= p->sat_ms;
+}
@@ -0,0 +1,32 @@
+#ifndef __FALL_H__
+#define __FALL_H__
+
+#include "ev3api.h"
+
+/**
+ * Early fall prediction. The robot is taken to be past saving when the
+ * angle it will reach horizon seconds ahead (gyro_angle + gyro_speed *
+ * horizon) is beyond angle degrees and the motors have been saturated
+ * towards the lean for sat_ms. keep_balance still gives up after
+ * FALL_TIME_MS of saturation if this never fires.
+ *
+ * tools/fallcheck picks the parameters for a false-positive budget.
+ */
+typedef struct {
+    float angle;      // deg
+    float horizon;    // s
+    uint32_t sat_ms;
+} fall_params_t;
+
+typedef struct {
+    SYSTIM since;     // last time the robot looked recoverable
+} fall_detector_t;
+
+void fall_reset(fall_detector_t* d, SYSTIM time);
+
+/**
+ * Returns true once the fall is predicted. power is the balance power before the motor limits.
+ */
+bool_t fall_predict(fall_detector_t* d, const fall_params_t* p, float angle, float speed, int power, SYSTIM time);
+
+#endif // __FALL_H__
@@ -0,0 +1,88 @@
+#include <string.h>
+#include "ev3api.h"
+#include "frame.h"
+
+static uint8_t crc8(uint8_t crc, uint8_t byte) {
+    crc ^= byte;
+    for (int i = 0; i < 8; i++)
+        crc = (crc & 0x80) ? (uint8_t)(crc << 1) ^ 0x07 : (uint8_t)(crc << 1);
+    return crc;
+}
+
+void frame_parser_init(frame_parser_t* p) {
+    memset(p, 0, sizeof(*p));
+}
+
+/**
+ * Drop count bytes from the front, then up to the next FRAME_SYNC.
+ */
+static void drop(frame_parser_t* p, int count) {
+    int i = count;
+    while (i < p->n && p->buf[i] != FRAME_SYNC)
+        i++;
+    memmove(p->buf, p->buf + i, p->n - i);
+    p->n -= i;
+}
+
+/**
+ * Returns 1 if the buffer starts with a complete frame, 0 if it needs more bytes, -1 if it is no frame.
+ */
+static int check(const frame_parser_t* p) {
+    if (p->n < 4)
+        return 0;
+    uint8_t len = p->buf[3];
+    if (len > FRAME_MAX_PAYLOAD)
+        return -1;
+    if (p->n < 5 + len)
+        return 0;
+
+    uint8_t crc = 0;
+    for (int i = 1; i < 4 + len; i++)
+        crc = crc8(crc, p->buf[i]);
+    return crc == p->buf[4 + len] ? 1 : -1;
+}
+
+bool_t frame_next(frame_parser_t* p) {
+    while (p->n > 0) {
+        int result = check(p);
+        if (result == 0)
+            return false;
+        if (result > 0) {
+            frame_t* f = &p->frame;
+            f->type = p->buf[1];
+            f->seq = p->buf[2];
+            f->len = p->buf[3];
+            memcpy(f->payload, &p->buf[4], f->len);
+            drop(p, 5 + f->len);
+            return true;
+        }
+        // A false start: look again from the next sync byte
+        p->errors++;
+        drop(p, 1);
+    }
+    return false;
+}
+
+bool_t frame_parse(frame_parser_t* p, uint8_t byte) {
+    if (p->n == 0 && byte != FRAME_SYNC)
+        return false;
+    // frame_next leaves less than a whole frame, so this always fits
+    p->buf[p->n++] = byte;
+    return frame_next(p);
+}
+
+int frame_encode(uint8_t* buf, uint8_t type, uint8_t seq, const void* payload, uint8_t len) {
+    assert(len <= FRAME_MAX_PAYLOAD);
+    buf[0] = FRAME_SYNC;
+    buf[1] = type;
+    buf[2] = seq;
+    buf[3] = len;
+    if (len)
+        memcpy(&buf[4], payload, len);
+
+    uint8_t crc = 0;
+    for (int i = 1; i < 4 + len; i++)
+        crc = crc8(crc, buf[i]);
+    buf[4 + len] = crc;
+    return 5 + len;
+}
@@ -0,0 +1,125 @@
+#ifndef __FRAME_H__
+#define __FRAME_H__
+
+#include "ev3api.h"
+#include "gains.h"
+
+/**
+ * Frames of the binary command and telemetry protocol on the serial port
+ * (remote.c on the robot, tools/btlink on a host).
+ *
+ * A frame is FRAME_SYNC, type, seq, len, len payload bytes, then a CRC-8
+ * (polynomial 0x07) of type to the end of the payload. Payloads are the
+ * structs below, little endian as on the EV3. Every command is answered
+ * with a FRAME_ACK carrying its type and seq.
+ */
+#define FRAME_SYNC         0xA5
+#define FRAME_MAX_PAYLOAD  40
+#define FRAME_MAX_SIZE     (FRAME_MAX_PAYLOAD + 5)
+
+typedef enum {
+    // Host to robot
+    FRAME_DRIVE     = 0x01,  // frame_setpoint_t: drive_target, deg/s
+    FRAME_STEER     = 0x02,  // frame_setpoint_t: steer_target, deg/s
+    FRAME_FIRE      = 0x03,  // frame_fire_t
+    FRAME_GAINS     = 0x04,  // frame_gains_t: store a gain vector in a slot
+    FRAME_TLM_RATE  = 0x05,  // frame_tlm_rate_t
+    FRAME_SELECT    = 0x06,  // frame_select_t: switch to the gains in a slot
+    FRAME_SAVE      = 0x07,  // no payload: save the gain slots to the SD card
+    // Robot to host
+    FRAME_ACK       = 0x81,  // frame_ack_t
+    FRAME_TELEMETRY = 0x82,  // frame_telemetry_t
+} frame_type_t;
+
+typedef enum {
+    ACK_OK,
+    ACK_REJECTED,  // valid, but not now (gun or gains busy, save failed) or not in this build (gains)
+    ACK_INVALID,   // unknown type, wrong payload size, or gains out of range (gains_valid)
+} frame_ack_status_t;
+
+typedef struct {
+    int16_t value;
+} frame_setpoint_t;
+
+typedef struct {
+    int8_t direction;   // +1 or -1, as gun_fire
+} frame_fire_t;
+
+typedef struct {
+    gain_vector_t gains;
+    uint8_t slot;       // 0 (A) to GAIN_SLOTS - 1
+    uint8_t reserved[3];
+} frame_gains_t;
+
+typedef struct {
+    uint8_t slot;
+} frame_select_t;
+
+typedef struct {
+    uint16_t period_ms; // 0 stops the telemetry
+} frame_tlm_rate_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t seq;
+    uint8_t status;     // frame_ack_status_t
+} frame_ack_t;
+
+typedef struct {
+    uint32_t time;          // SYSTIM, ms
+    int32_t  x, y;          // pose_t
+    uint32_t heading;
+    float    gyro_angle;    // deg
+    float    gyro_speed;    // deg/s
+    int16_t  drive_target;
+    int16_t  steer_target;
+    uint16_t battery_mV;
+    uint16_t misses;        // watchdog_misses
+    uint8_t  status;        // gyrohunter_status_t
+    uint8_t  load_level;
+    int8_t   left_power;
+    int8_t   right_power;
+    uint8_t  gain_slot;     // gains_active
+    uint8_t  period_ms;     // balance_period_ms
+    int8_t   margin_pct;    // period_info
+    uint8_t  stale_pct;     // period_info, gyro repeats over those at WAIT_TIME_MS
+} frame_telemetry_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t seq;
+    uint8_t len;
+    uint8_t payload[FRAME_MAX_PAYLOAD];
+} frame_t;
+
+typedef struct {
+    uint8_t buf[FRAME_MAX_SIZE];  // bytes from the last FRAME_SYNC on
+    uint8_t n;
+    frame_t frame;
+    uint32_t errors;    // false starts dropped for a bad length or CRC
+} frame_parser_t;
+
+void frame_parser_init(frame_parser_t* p);
+
+/**
+ * Feed one byte. Returns true when p->frame holds a complete frame.
+ *
+ * A bad length or CRC drops only the FRAME_SYNC the frame started with, and
+ * the bytes after it are scanned again from the next FRAME_SYNC: when a byte
+ * is lost, the next frame was read as the end of the broken one and is still
+ * found. That can leave more complete frames buffered, so call frame_next
+ * until it returns false after every frame_parse that returned true.
+ */
+bool_t frame_parse(frame_parser_t* p, uint8_t byte);
+
+/**
+ * Take the next complete frame from the bytes already fed, as frame_parse.
+ */
+bool_t frame_next(frame_parser_t* p);
+
+/**
+ * Write a frame into buf (FRAME_MAX_SIZE bytes). Returns its size.
+ */
+int frame_encode(uint8_t* buf, uint8_t type, uint8_t seq, const void* payload, uint8_t len);
+
+#endif // __FRAME_H__
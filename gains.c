@@ -0,0 +1,138 @@
+#include <math.h>
+#include <stddef.h>
+#include "ev3api.h"
+#include "balance.h"
+#include "gains.h"
+
+#ifdef TUNABLE_GAINS
+
+/**
+ * slots is plain memory shared with balance_task, so the compiler must not
+ * move its stores past the volatile pending that hands it over.
+ */
+#define COMPILER_BARRIER() __asm__ volatile("" ::: "memory")
+
+static gain_vector_t compiled;
+static gain_vector_t slots[GAIN_SLOTS];
+static int selected;                    // main_task's view of the active slot
+static volatile int pending = -1;       // slot for balance_task to apply, -1 if none
+
+static void apply(const gain_vector_t* v) {
+    KGYROANGLE = v->kgyroangle;
+    KGYROSPEED = v->kgyrospeed;
+    KPOS = v->kpos;
+    KSPEED = v->kspeed;
+    KGUN = v->kgun;
+    balance_gains_changed();
+}
+
+static bool_t gain_valid(float k, float compiled_k) {
+    return isfinite(k) && fabsf(k) <= GAIN_MAX_FACTOR * fabsf(compiled_k);
+}
+
+bool_t gains_valid(const gain_vector_t* v) {
+    return gain_valid(v->kgyroangle, compiled.kgyroangle) &&
+           gain_valid(v->kgyrospeed, compiled.kgyrospeed) &&
+           gain_valid(v->kpos, compiled.kpos) &&
+           gain_valid(v->kspeed, compiled.kspeed) &&
+           gain_valid(v->kgun, compiled.kgun);
+}
+
+static uint32_t checksum(const gains_file_t* f) {
+    const uint32_t* w = (const uint32_t*)f;
+    uint32_t sum = 0;
+    for (int i = 0; i < offsetof(gains_file_t, checksum) / 4; i++)
+        sum += w[i];
+    return sum;
+}
+
+void gains_init() {
+    gain_vector_t v = { KGYROANGLE, KGYROSPEED, KPOS, KSPEED, KGUN };
+    compiled = v;
+    for (int i = 0; i < GAIN_SLOTS; i++)
+        slots[i] = v;
+    selected = 0;
+    pending = -1;
+}
+
+bool_t gains_load() {
+    gains_file_t f;
+    FILE* file = fopen(GAINS_PATH, "rb");
+    if (file == NULL)
+        return false;
+    size_t n = fread(&f, sizeof(f), 1, file);
+    fclose(file);
+
+    if (n != 1 || f.magic != GAINS_MAGIC || f.version != GAINS_VERSION || f.size != sizeof(f)
+        || f.gain_profile != GAIN_PROFILE || f.active >= GAIN_SLOTS || f.checksum != checksum(&f)) {
+        syslog(LOG_WARNING, "Ignoring %s, it is not for this build.", GAINS_PATH);
+        return false;
+    }
+    for (int i = 0; i < GAIN_SLOTS; i++) {
+        if (!gains_valid(&f.slots[i])) {
+            syslog(LOG_WARNING, "Ignoring %s, slot %c is out of range.", GAINS_PATH, 'A' + i);
+            return false;
+        }
+    }
+
+    for (int i = 0; i < GAIN_SLOTS; i++)
+        slots[i] = f.slots[i];
+    selected = f.active;
+    pending = -1;
+    apply(&slots[selected]);
+    return true;
+}
+
+bool_t gains_save() {
+    gains_file_t f = { GAINS_MAGIC, GAINS_VERSION, sizeof(f), GAIN_PROFILE, selected };
+    for (int i = 0; i < GAIN_SLOTS; i++)
+        f.slots[i] = slots[i];
+    f.checksum = checksum(&f);
+
+    FILE* file = fopen(GAINS_PATH, "wb");
+    if (file == NULL) {
+        syslog(LOG_ERROR, "Cannot open %s.", GAINS_PATH);
+        return false;
+    }
+    size_t n = fwrite(&f, sizeof(f), 1, file);
+    fclose(file);
+    return n == 1;
+}
+
+bool_t gains_set(int slot, const gain_vector_t* v) {
+    if (slot < 0 || slot >= GAIN_SLOTS || pending >= 0 || !gains_valid(v))
+        return false;
+    slots[slot] = *v;
+    COMPILER_BARRIER();
+    if (slot == selected)
+        pending = slot;
+    return true;
+}
+
+bool_t gains_select(int slot) {
+    if (slot < 0 || slot >= GAIN_SLOTS || pending >= 0)
+        return false;
+    selected = slot;
+    pending = slot;
+    return true;
+}
+
+void gains_get(int slot, gain_vector_t* v) {
+    *v = slots[slot];
+}
+
+int gains_active() {
+    return selected;
+}
+
+bool_t gains_tick() {
+    int slot = pending;
+    if (slot < 0)
+        return false;
+    apply(&slots[slot]);
+    COMPILER_BARRIER();
+    pending = -1;
+    return true;
+}
+
+#endif // TUNABLE_GAINS
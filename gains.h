@@ -0,0 +1,97 @@
+#ifndef __GAINS_H__
+#define __GAINS_H__
+
+#include "ev3api.h"
+#include "balance.h"
+
+/**
+ * Live tuning of the TUNABLE_GAINS gains as whole vectors.
+ *
+ * There are GAIN_SLOTS stored vectors (A and B) and one of them is active.
+ * main_task changes a slot or selects another one; balance_task picks the
+ * change up in gains_tick at the top of its next loop and copies the whole
+ * vector into the gains at once, so no balance_step ever sees half of it.
+ *
+ * gains_save writes both slots and the active one to GAINS_PATH as a raw
+ * gains_file_t. balance_task reads it back with gains_load before it
+ * calibrates the gyro; the record is checked, not parsed.
+ */
+#ifndef GAINS_PATH
+#define GAINS_PATH     "/gyrohunter.gains"
+#endif
+#define GAINS_MAGIC    0x4E494147  // "GAIN"
+#define GAINS_VERSION  1
+#define GAIN_SLOTS     2
+#define GAIN_MAX_FACTOR 10.0f  // a gain may be at most this many times its compiled-in size
+
+typedef struct {
+    float kgyroangle;
+    float kgyrospeed;
+    float kpos;
+    float kspeed;
+    float kgun;
+} gain_vector_t;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;          // sizeof(gains_file_t)
+    uint8_t  gain_profile;  // GAIN_PROFILE the gains were tuned for
+    uint8_t  active;
+    uint8_t  reserved[2];
+    gain_vector_t slots[GAIN_SLOTS];
+    uint32_t checksum;      // sum of the 32-bit words before it
+} gains_file_t;
+
+#ifdef TUNABLE_GAINS
+
+/**
+ * Fill every slot with the compiled-in gains and make slot 0 active.
+ */
+void gains_init();
+
+/**
+ * Load GAINS_PATH and apply its active slot at once. Returns false, and keeps
+ * the current gains, if the file is missing or not for this build.
+ */
+bool_t gains_load();
+
+/**
+ * Write the slots to GAINS_PATH. main_task only.
+ */
+bool_t gains_save();
+
+/**
+ * True if every gain is finite and no more than GAIN_MAX_FACTOR times the
+ * compiled-in one in size.
+ */
+bool_t gains_valid(const gain_vector_t* v);
+
+/**
+ * Store a vector in a slot; it takes effect at the next tick if the slot is active.
+ * Returns false for a vector that is not gains_valid, or while the last
+ * change has not been picked up yet. main_task only.
+ */
+bool_t gains_set(int slot, const gain_vector_t* v);
+
+/**
+ * Make a slot active at the next tick. Same rules as gains_set.
+ */
+bool_t gains_select(int slot);
+
+void gains_get(int slot, gain_vector_t* v);
+
+/**
+ * The slot that is active, or will be at the next tick.
+ */
+int gains_active();
+
+/**
+ * Apply a pending change. balance_task only, between two balance_steps.
+ * Returns true if the gains changed.
+ */
+bool_t gains_tick();
+
+#endif // TUNABLE_GAINS
+
+#endif // __GAINS_H__
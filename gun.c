@@ -0,0 +1,45 @@
+#include "ev3api.h"
+#include "balance.h"
+#include "gun.h"
+
+static SYSTIM last_fire_time;
+static bool_t fired = false;
+static bool_t armed = false;
+
+bool_t gun_fire(int direction) {
+    SYSTIM now;
+    ER ercd = get_tim(&now);
+    assert(ercd == E_OK);
+
+    if (!armed || (fired && now - last_fire_time < GUN_REARM_MS))
+        return false;
+    // Reversing mid-burst would kick the body twice as hard as a start
+    if (gun_direction != 0 && gun_direction != direction)
+        return false;
+
+    int32_t cnt = ev3_motor_get_counts(gun_motor);
+    int32_t target = (gun_direction == direction ? gun_target : cnt) + direction * FIRE_TURNS * 360;
+    ev3_motor_rotate(gun_motor, target - cnt, 100, false);
+    gun_target = target;
+    gun_direction = direction;
+
+    last_fire_time = now;
+    fired = true;
+    return true;
+}
+
+void gun_update() {
+    if (gun_direction != 0 && gun_direction * (gun_target - ev3_motor_get_counts(gun_motor)) <= GUN_DONE_DEG)
+        gun_direction = 0;
+}
+
+void gun_reset() {
+    armed = false;
+    ev3_motor_stop(gun_motor, false);
+    gun_direction = 0;
+    fired = false;
+}
+
+void gun_arm() {
+    armed = true;
+}
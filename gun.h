@@ -0,0 +1,39 @@
+#ifndef __GUN_H__
+#define __GUN_H__
+
+#include "ev3api.h"
+
+/**
+ * The gun: each fire command turns the gun motor FIRE_TURNS times on the
+ * motor controller (ev3_motor_rotate), without blocking the caller.
+ * gun_fire publishes the burst in gun_direction and gun_target (balance.h)
+ * so that balance_step can cancel the gun's reaction torque, and gun_update
+ * clears it once the gun has arrived.
+ */
+#define FIRE_TURNS    15
+#define GUN_REARM_MS  500  // min time between two fire commands
+#define GUN_DONE_DEG  10   // the burst is over this close to gun_target
+
+/**
+ * Start a burst, or add FIRE_TURNS to the one running in the same direction (+1 or -1).
+ * Returns false if the gun is re-arming, busy the other way, or not armed.
+ */
+bool_t gun_fire(int direction);
+
+/**
+ * Call periodically from main_task to notice the end of a burst.
+ */
+void gun_update();
+
+/**
+ * Stop the gun motor, forget the last burst and refuse fire commands until
+ * gun_arm. balance_task calls it when a run starts and at a knock out.
+ */
+void gun_reset();
+
+/**
+ * Accept fire commands. balance_task calls it once the robot is balancing.
+ */
+void gun_arm();
+
+#endif // __GUN_H__
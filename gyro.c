@@ -0,0 +1,36 @@
+#include "ev3api.h"
+#include "balance.h"
+#include "gyro.h"
+
+gyro_stats_t gyro_stats;
+
+static uint32_t interval_us;
+static bool_t started;
+static SYSUTM last_fresh;
+static int last_rate, last_read;
+
+void gyro_reset(uint32_t us) {
+    interval_us = us;
+    started = false;
+    gyro_stats.samples = gyro_stats.stale = gyro_stats.repeats = 0;
+}
+
+bool_t gyro_sample(int* rate) {
+    SYSUTM now;
+    ER ercd = get_utm(&now);
+    assert(ercd == E_OK);
+    *rate = ev3_gyro_sensor_get_rate(gyro_sensor);
+    gyro_stats.samples++;
+    if (started && *rate == last_read)
+        gyro_stats.repeats++;
+    last_read = *rate;
+
+    if (interval_us != 0 && started && *rate == last_rate && now - last_fresh < interval_us) {
+        gyro_stats.stale++;
+        return false;
+    }
+    started = true;
+    last_fresh = now;
+    last_rate = *rate;
+    return true;
+}
@@ -0,0 +1,29 @@
+#ifndef __GYRO_H__
+#define __GYRO_H__
+
+#include "ev3api.h"
+
+/**
+ * Freshness of the gyro samples. The sensor sends no sequence number, so a
+ * reading unchanged within its update interval (gyro_reset) is taken to
+ * repeat the last sample. With no interval set every sample is fresh.
+ */
+typedef struct {
+    uint32_t samples;
+    uint32_t stale;     // repeats within the update interval
+    uint32_t repeats;   // readings equal to the last one, whatever the timing (period.c)
+} gyro_stats_t;
+
+extern gyro_stats_t gyro_stats;
+
+/**
+ * Start a run with the sensor's update interval (us, 0 if unknown) and clear the counts.
+ */
+void gyro_reset(uint32_t interval_us);
+
+/**
+ * Read the gyro rate (deg/s). Returns false if it repeats a sample already read.
+ */
+bool_t gyro_sample(int* rate);
+
+#endif // __GYRO_H__
@@ -0,0 +1,80 @@
+#include <math.h>
+#include "ev3api.h"
+#include "odometry.h"
+
+/**
+ * Quarter-wave sine table, Q15, with the end point for interpolation.
+ * The top ODOMETRY_LUT_BITS+2 bits of a binary angle pick the quadrant and
+ * entry, the next 16 bits interpolate: worst error about 2e-5.
+ */
+#define ODOMETRY_LUT_BITS 8
+#define ODOMETRY_LUT_SIZE (1 << ODOMETRY_LUT_BITS)
+
+static int16_t sin_lut[ODOMETRY_LUT_SIZE + 1];
+static int32_t dist_scale;     // 1/ODOMETRY_ONE mm of travel per count of left + right, Q16
+static int32_t heading_scale;  // binary angle per count of right - left
+static int32_t prev_left, prev_right;
+static volatile pose_t pose;
+static volatile uint32_t pose_seq;  // odd while balance_task is writing pose
+
+void odometry_init(float wheel_diameter, float track_width) {
+    for (int i = 0; i <= ODOMETRY_LUT_SIZE; i++)
+        sin_lut[i] = (int16_t)lroundf(32767 * sinf(i * (float)M_PI / 2 / ODOMETRY_LUT_SIZE));
+
+    // Each wheel moves pi * D / 360 cm per count; the body moves half the sum and turns the difference over the track
+    double mm_per_cnt = M_PI * wheel_diameter * 10 / 360;
+    dist_scale = (int32_t)lround(mm_per_cnt / 2 * ODOMETRY_ONE * 65536);
+    heading_scale = (int32_t)lround(mm_per_cnt / (track_width * 10) / (2 * M_PI) * 4294967296.0);
+}
+
+/**
+ * sin of a binary angle, Q15.
+ */
+static int32_t lut_sin(uint32_t a) {
+    uint32_t quadrant = a >> 30;
+    uint32_t pos = (a >> (30 - ODOMETRY_LUT_BITS - 16)) & ((ODOMETRY_LUT_SIZE << 16) - 1);
+    if (quadrant & 1)
+        pos = (ODOMETRY_LUT_SIZE << 16) - pos;
+    uint32_t i = pos >> 16, frac = pos & 0xffff;
+    int32_t s = sin_lut[i];
+    if (frac)
+        s += ((sin_lut[i + 1] - s) * (int32_t)frac) >> 16;
+    return (quadrant & 2) ? -s : s;
+}
+
+void odometry_reset(int32_t left_cnt, int32_t right_cnt) {
+    prev_left = left_cnt;
+    prev_right = right_cnt;
+    pose_seq++;
+    pose.x = pose.y = 0;
+    pose.heading = 0;
+    pose_seq++;
+}
+
+void odometry_update(int32_t left_cnt, int32_t right_cnt) {
+    int32_t dl = left_cnt - prev_left, dr = right_cnt - prev_right;
+    prev_left = left_cnt;
+    prev_right = right_cnt;
+    if (dl == 0 && dr == 0)
+        return;
+
+    // Move along the mean heading over the tick
+    // Round rather than truncate, or the bias adds up over thousands of ticks
+    int32_t dist = (int32_t)(((int64_t)(dl + dr) * dist_scale + (1 << 15)) >> 16);
+    uint32_t turn = (uint32_t)((dr - dl) * heading_scale);
+    uint32_t mid = pose.heading + (uint32_t)((int32_t)turn >> 1);
+
+    pose_seq++;
+    pose.x += (dist * lut_sin(mid + 0x40000000u) + (1 << 14)) >> 15;
+    pose.y += (dist * lut_sin(mid) + (1 << 14)) >> 15;
+    pose.heading += turn;
+    pose_seq++;
+}
+
+void odometry_get_pose(pose_t* out) {
+    uint32_t seq;
+    do {
+        seq = pose_seq;
+        *out = pose;
+    } while ((seq & 1) || seq != pose_seq);
+}
@@ -0,0 +1,44 @@
+#ifndef __ODOMETRY_H__
+#define __ODOMETRY_H__
+
+#include <stdint.h>
+
+/**
+ * Dead reckoning from the wheel encoders, updated by balance_step every tick.
+ *
+ * Fixed point throughout: x and y are in 1/ODOMETRY_ONE mm, heading is a
+ * binary angle (2^32 per turn, counter-clockwise positive, so it wraps for
+ * free). The start of a run is the origin, facing along x.
+ */
+#define ODOMETRY_SHIFT 8
+#define ODOMETRY_ONE   (1 << ODOMETRY_SHIFT)
+
+#define ODOMETRY_MM(v)   ((v) >> ODOMETRY_SHIFT)
+#define ODOMETRY_DEG(h)  ((int32_t)(h) / (int32_t)(0x80000000u / 180))  // -180..180
+
+typedef struct {
+    int32_t x, y;      // 1/ODOMETRY_ONE mm
+    uint32_t heading;  // 2^32 per turn
+} pose_t;
+
+/**
+ * Compute the scale factors and the sine table. wheel_diameter and track_width in cm.
+ */
+void odometry_init(float wheel_diameter, float track_width);
+
+/**
+ * Start again from the origin at the given encoder counts.
+ */
+void odometry_reset(int32_t left_cnt, int32_t right_cnt);
+
+/**
+ * Advance the pose by the encoder counts since the last call. balance_task only.
+ */
+void odometry_update(int32_t left_cnt, int32_t right_cnt);
+
+/**
+ * Consistent copy of the latest pose, from any task.
+ */
+void odometry_get_pose(pose_t* pose);
+
+#endif // __ODOMETRY_H__
@@ -0,0 +1,135 @@
+#include <string.h>
+#include "ev3api.h"
+#include "balance.h"
+#include "gyro.h"
+#include "period.h"
+
+period_info_t period_info;
+
+static int ticks, over_windows;
+static int probe_loops, probe_intervals;
+static gyro_stats_t window_start;
+
+static void set_wait(uint32_t wait_ms) {
+    uint32_t loop_us = (wait_ms + STEP_TIME_MS) * 1000;
+    balance_set_period(wait_ms);
+    period_info.wait_ms = wait_ms;
+    period_info.margin_pct = 100 - (int)(period_info.step_us * 100 / loop_us);
+}
+
+void period_reset() {
+    memset(&period_info, 0, sizeof(period_info));
+    ticks = over_windows = probe_loops = probe_intervals = 0;
+    gyro_reset(0);
+    window_start = gyro_stats;
+}
+
+bool_t period_probe(SYSUTM until) {
+    if (probe_loops >= PROBE_LOOPS)
+        return false;
+
+    SYSUTM now, last_change = 0;
+    bool_t changed = false;
+    int timed = 0;
+    int16_t last = ev3_gyro_sensor_get_rate(gyro_sensor);
+    do {
+        get_utm(&now);
+        int16_t rate = ev3_gyro_sensor_get_rate(gyro_sensor);
+        if (rate == last)
+            continue;
+        // Only two changes seen in the same wait bound an interval
+        if (changed) {
+            if (probe_intervals == 0 || now - last_change < period_info.sensor_us)
+                period_info.sensor_us = now - last_change;
+            probe_intervals++;
+            timed++;
+        }
+        changed = true;
+        last_change = now;
+        last = rate;
+    } while (now < until && timed < PROBE_WAIT_INTERVALS);
+
+    // Sleep through the rest of the wait so other tasks run, and spin only its last fraction of a millisecond
+    if (now < until) {
+        tslp_tsk((until - now) / 1000);
+        do
+            get_utm(&now);
+        while (now < until);
+    }
+
+    if (++probe_loops == PROBE_LOOPS) {
+        if (probe_intervals < PROBE_MIN_INTERVALS) {
+            syslog(LOG_WARNING, "Period: only %d gyro updates timed, keeping %d ms.",
+                   probe_intervals, (int)WAIT_TIME_MS);
+            period_info.sensor_us = 0;
+        } else {
+            syslog(LOG_NOTICE, "Period: %d gyro updates timed, every %d us at best.",
+                   probe_intervals, (int)period_info.sensor_us);
+        }
+        gyro_reset(period_info.sensor_us);
+        window_start = gyro_stats;
+    }
+    return true;
+}
+
+/**
+ * Share of the gyro readings since the last window that equal the one before.
+ */
+static int repeat_pct() {
+    uint32_t samples = gyro_stats.samples - window_start.samples;
+    uint32_t repeats = gyro_stats.repeats - window_start.repeats;
+    window_start = gyro_stats;
+    return samples == 0 ? 0 : (int)(repeats * 100 / samples);
+}
+
+void period_step_done(uint32_t step_us) {
+    if (period_info.wait_ms == 0 && step_us > period_info.step_us)
+        period_info.step_us = step_us;
+    // A fixed time, whatever the period, so a window holds enough readings to compare
+    int window = period_info.wait_ms == 0 ? PERIOD_TICKS
+        : STALE_WINDOW_MS / (balance_period_ms + STEP_TIME_MS);
+    if (++ticks < window)
+        return;
+    ticks = 0;
+
+    if (period_info.wait_ms != 0) {
+        int pct = repeat_pct() - period_info.repeat_pct;
+        period_info.stale_pct = pct > 0 ? pct : 0;
+        if (balance_period_ms >= WAIT_TIME_MS || period_info.stale_pct <= STALE_MAX_PCT) {
+            over_windows = 0;
+            return;
+        }
+        // The gyro cannot keep up with the shorter loop after all
+        if (++over_windows >= STALE_WINDOWS) {
+            over_windows = 0;
+            period_back_off();
+        }
+        return;
+    }
+
+    // Readings at WAIT_TIME_MS are new samples, so this is how often they just match
+    period_info.repeat_pct = repeat_pct();
+
+    // An unknown sensor keeps WAIT_TIME_MS
+    uint32_t wait_ms = WAIT_TIME_MS;
+    if (period_info.sensor_us != 0) {
+        uint32_t loop_us = period_info.step_us * STEP_HEADROOM;
+        if (loop_us < period_info.sensor_us)
+            loop_us = period_info.sensor_us;
+        for (wait_ms = PERIOD_MIN_MS; wait_ms < WAIT_TIME_MS; wait_ms++)
+            if ((wait_ms + STEP_TIME_MS) * 1000 >= loop_us)
+                break;
+    }
+    set_wait(wait_ms);
+    syslog(LOG_NOTICE, "Period: wait %d ms, worst step %d us, margin %d%%, %d%% gyro repeats.",
+           (int)wait_ms, (int)period_info.step_us, period_info.margin_pct, period_info.repeat_pct);
+}
+
+bool_t period_back_off() {
+    if (balance_period_ms >= WAIT_TIME_MS)
+        return false;
+    set_wait(balance_period_ms + 1);
+    syslog(LOG_NOTICE, "Period: backing off to %d ms, margin %d%%, %d%% more gyro repeats.",
+           (int)balance_period_ms, period_info.margin_pct, period_info.stale_pct);
+    return true;
+}
@@ -0,0 +1,59 @@
+#ifndef __PERIOD_H__
+#define __PERIOD_H__
+
+#include "ev3api.h"
+
+/**
+ * Choice of the control period for each run with ADAPTIVE_PERIOD (README,
+ * Control Period). balance_task calls period_reset when a run starts,
+ * period_probe in place of its sleep and period_step_done after every
+ * balance_step. The wait starts at WAIT_TIME_MS, changes once after
+ * PERIOD_TICKS loops and then only backs off, never past WAIT_TIME_MS.
+ */
+#define PROBE_LOOPS          40    // loops that time the gyro's updates
+#define PROBE_MIN_INTERVALS  10    // fewer timed: the update interval is unknown
+#define PROBE_WAIT_INTERVALS 2     // timed in one wait, then period_probe sleeps
+#define PERIOD_TICKS         200   // loops at WAIT_TIME_MS before the wait is chosen
+#define PERIOD_MIN_MS        1
+#define STEP_HEADROOM        3     // the loop is at least this many worst steps
+#define STALE_WINDOW_MS      1000  // gyro repeats are compared once per window
+#define STALE_WINDOWS        2     // windows in a row over STALE_MAX_PCT that back off
+#define STALE_MAX_PCT        20    // points of repeats allowed over the share at WAIT_TIME_MS
+
+typedef struct {
+    uint32_t sensor_us;   // gyro update interval, 0 if unknown
+    uint32_t step_us;     // worst balance_step over PERIOD_TICKS
+    uint32_t wait_ms;     // chosen wait, 0 until chosen
+    int margin_pct;       // share of the loop left after the worst step
+    int repeat_pct;       // share of gyro readings equal to the last at WAIT_TIME_MS
+    int stale_pct;        // points over repeat_pct in the last window with a shorter wait
+} period_info_t;
+
+extern period_info_t period_info;
+
+/**
+ * Start a run at WAIT_TIME_MS. Call after balance_start.
+ */
+void period_reset();
+
+/**
+ * For the first PROBE_LOOPS loops of a run, time the gyro's updates until the
+ * loop is due (get_utm time), sleeping once PROBE_WAIT_INTERVALS are timed,
+ * and return true; after that return false, and the caller sleeps.
+ */
+bool_t period_probe(SYSUTM until);
+
+/**
+ * Call after every balance_step with its execution time. After PERIOD_TICKS
+ * chooses the shortest wait whose loop is no shorter than the gyro's update
+ * interval and at least STEP_HEADROOM worst steps. Then backs off a
+ * millisecond when the gyro repeats stay too high (STALE_*).
+ */
+void period_step_done(uint32_t step_us);
+
+/**
+ * Wait a millisecond longer, up to WAIT_TIME_MS. Returns false if already there. balance_task only.
+ */
+bool_t period_back_off();
+
+#endif // __PERIOD_H__
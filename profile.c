@@ -0,0 +1,55 @@
+#include <math.h>
+#include "profile.h"
+
+void profile_init(motion_profile_t* p, float accel, float jerk)
+{
+    p->accel = accel;
+    p->jerk = jerk;
+    profile_reset(p);
+}
+
+void profile_reset(motion_profile_t* p)
+{
+    p->target = 0;
+    p->value = 0;
+    p->rate = 0;
+}
+
+void profile_set_target(motion_profile_t* p, float target)
+{
+    p->target = target;
+}
+
+/**
+ * Advance the profile by dt seconds and return the new value.
+ * The rate is limited to accel and changes by at most jerk * dt per call.
+ * Near the target the rate is capped to sqrt(2 * jerk * error), so the
+ * profile can always ramp the rate back to zero before it arrives.
+ */
+float profile_step(motion_profile_t* p, float dt)
+{
+    float err = p->target - p->value;
+    if (err == 0 && p->rate == 0) return p->value;
+
+    float want = sqrtf(2.0f * p->jerk * fabsf(err));
+    if (want > p->accel) want = p->accel;
+    if (err < 0) want = -want;
+
+    float max_delta = p->jerk * dt;
+    if (want > p->rate + max_delta)
+        p->rate += max_delta;
+    else if (want < p->rate - max_delta)
+        p->rate -= max_delta;
+    else
+        p->rate = want;
+
+    float step = p->rate * dt;
+    if ((err >= 0 && step >= err) || (err <= 0 && step <= err)) {
+        p->value = p->target;
+        p->rate = 0;
+    } else {
+        p->value += step;
+    }
+
+    return p->value;
+}
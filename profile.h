@@ -0,0 +1,22 @@
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+/**
+ * Acceleration and jerk limited setpoint generator.
+ * The caller sets a target and steps the profile once per control tick;
+ * value follows the target without steps in its first derivative.
+ */
+typedef struct {
+    float accel;   // max rate of change of value (units/s)
+    float jerk;    // max rate of change of the rate (units/s^2)
+    float target;
+    float value;
+    float rate;
+} motion_profile_t;
+
+void profile_init(motion_profile_t* p, float accel, float jerk);
+void profile_reset(motion_profile_t* p);
+void profile_set_target(motion_profile_t* p, float target);
+float profile_step(motion_profile_t* p, float dt);
+
+#endif // __PROFILE_H__
@@ -0,0 +1,75 @@
+#include "ev3api.h"
+#include "recorder.h"
+
+#define RECORDER_BUFFER_SIZE 512 // 2.5 s at 5 ms per tick
+
+static balance_record_t buffer[RECORDER_BUFFER_SIZE];
+static volatile uint32_t head, tail; // head is written by balance_task only, tail by record_task only
+static bool_t gap;
+static FILE* file = NULL;
+
+uint32_t recorder_dropped = 0;
+
+void recorder_start(float gyro_offset) {
+    balance_record_t r = { 0 };
+    r.flags = RECORD_START;
+    r.gyro_offset = gyro_offset;
+    recorder_push(&r);
+    recorder_gains();
+}
+
+void recorder_gains() {
+#ifdef TUNABLE_GAINS
+    balance_record_t r = { 0 };
+    r.flags = RECORD_GAINS;
+    r.gains[0] = KGYROANGLE;
+    r.gains[1] = KGYROSPEED;
+    r.gains[2] = KPOS;
+    r.gains[3] = KSPEED;
+    r.gains[4] = KGUN;
+    recorder_push(&r);
+#endif
+}
+
+void recorder_push(const balance_record_t* r) {
+    if (head - tail >= RECORDER_BUFFER_SIZE) {
+        recorder_dropped++;
+        gap = true;
+        return;
+    }
+
+    balance_record_t* slot = &buffer[head % RECORDER_BUFFER_SIZE];
+    *slot = *r;
+    if (gap) {
+        slot->flags |= RECORD_GAP;
+        gap = false;
+    }
+    head++;
+}
+
+void recorder_flush() {
+    if (head == tail) return;
+
+    if (file == NULL) {
+        file = fopen(RECORDER_PATH, "wb");
+        if (file == NULL) {
+            syslog(LOG_ERROR, "Cannot open %s.", RECORDER_PATH);
+            tail = head;
+            return;
+        }
+        recorder_header_t header = { RECORDER_MAGIC, RECORDER_VERSION, sizeof(balance_record_t) };
+        fwrite(&header, sizeof(header), 1, file);
+    }
+
+    // Write the pending records in at most two contiguous chunks
+    uint32_t end = head;
+    while (tail != end) {
+        uint32_t idx = tail % RECORDER_BUFFER_SIZE;
+        uint32_t n = end - tail;
+        if (n > RECORDER_BUFFER_SIZE - idx)
+            n = RECORDER_BUFFER_SIZE - idx;
+        fwrite(&buffer[idx], sizeof(balance_record_t), n, file);
+        tail += n;
+    }
+    fflush(file);
+}
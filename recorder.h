@@ -0,0 +1,42 @@
+#ifndef __RECORDER_H__
+#define __RECORDER_H__
+
+#include "balance.h"
+
+/**
+ * Capture of balance_step records to the SD card.
+ *
+ * balance_task pushes one record per tick into a RAM ring buffer and never
+ * blocks; record_task drains it to RECORDER_PATH. The file is a
+ * recorder_header_t followed by balance_record_t entries, and a new run
+ * (after a knock out) starts with a RECORD_START entry. With TUNABLE_GAINS a
+ * RECORD_GAINS entry follows it, and another one every time the gains change.
+ */
+#ifndef RECORDER_PATH
+#define RECORDER_PATH     "/gyrohunter.rec"
+#endif
+#define RECORDER_MAGIC    0x43524847  // "GHRC"
+#define RECORDER_VERSION  4
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+} recorder_header_t;
+
+/**
+ * Records dropped because the ring buffer was full.
+ */
+extern uint32_t recorder_dropped;
+
+void recorder_start(float gyro_offset);
+
+/**
+ * Record the gains in use. Call after every change that balance_step will see.
+ */
+void recorder_gains();
+
+void recorder_push(const balance_record_t* r);
+void recorder_flush();
+
+#endif // __RECORDER_H__
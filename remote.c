@@ -0,0 +1,193 @@
+#include <string.h>
+#include "ev3api.h"
+#include "balance.h"
+#include "gains.h"
+#include "gun.h"
+#include "odometry.h"
+#include "period.h"
+#include "remote.h"
+#include "watchdog.h"
+
+static uint8_t ring[REMOTE_BUFFER_SIZE];
+static volatile uint32_t head, tail; // head is written by serial_task only, tail by main_task only
+static FILE* in_file = NULL;
+static FILE* out_file = NULL;
+static frame_parser_t parser;
+
+static bool_t in_control = false;
+static SYSTIM last_command_time;
+static uint16_t telemetry_period_ms;
+static SYSTIM last_telemetry_time;
+static uint8_t telemetry_seq;
+
+uint32_t remote_dropped = 0;
+uint32_t remote_errors = 0;
+
+void remote_open(FILE* in, FILE* out) {
+    in_file = in;
+    out_file = out;
+    frame_parser_init(&parser);
+}
+
+bool_t remote_receive() {
+    int c = fgetc(in_file);
+    if (c == EOF) {
+        clearerr(in_file);
+        return false;
+    }
+    if (head - tail >= REMOTE_BUFFER_SIZE) {
+        remote_dropped++;
+        return true;
+    }
+    ring[head % REMOTE_BUFFER_SIZE] = (uint8_t)c;
+    head++;
+    return true;
+}
+
+static void send_frame(uint8_t type, uint8_t seq, const void* payload, uint8_t len) {
+    uint8_t buf[FRAME_MAX_SIZE];
+    fwrite(buf, 1, frame_encode(buf, type, seq, payload, len), out_file);
+    fflush(out_file);
+}
+
+static int clamp(int value, int limit) {
+    return value > limit ? limit : value < -limit ? -limit : value;
+}
+
+static frame_ack_status_t apply_command(const frame_t* f) {
+    switch (f->type) {
+    case FRAME_DRIVE:
+    case FRAME_STEER:
+        {
+            if (f->len != sizeof(frame_setpoint_t)) return ACK_INVALID;
+            frame_setpoint_t sp;
+            memcpy(&sp, f->payload, sizeof(sp));
+            if (f->type == FRAME_DRIVE)
+                drive_target = clamp(sp.value, MAX_SPEED);
+            else
+                steer_target = clamp(sp.value, MAX_STEER);
+            in_control = true;
+            return ACK_OK;
+        }
+
+    case FRAME_FIRE:
+        {
+            if (f->len != sizeof(frame_fire_t)) return ACK_INVALID;
+            frame_fire_t fire;
+            memcpy(&fire, f->payload, sizeof(fire));
+            if (fire.direction != 1 && fire.direction != -1) return ACK_INVALID;
+            return gun_fire(fire.direction) ? ACK_OK : ACK_REJECTED;
+        }
+
+    case FRAME_GAINS:
+        {
+            if (f->len != sizeof(frame_gains_t)) return ACK_INVALID;
+#ifdef TUNABLE_GAINS
+            frame_gains_t g;
+            memcpy(&g, f->payload, sizeof(g));
+            if (g.slot >= GAIN_SLOTS || !gains_valid(&g.gains)) return ACK_INVALID;
+            return gains_set(g.slot, &g.gains) ? ACK_OK : ACK_REJECTED;
+#else
+            return ACK_REJECTED;
+#endif
+        }
+
+    case FRAME_SELECT:
+        {
+            if (f->len != sizeof(frame_select_t)) return ACK_INVALID;
+#ifdef TUNABLE_GAINS
+            frame_select_t sel;
+            memcpy(&sel, f->payload, sizeof(sel));
+            if (sel.slot >= GAIN_SLOTS) return ACK_INVALID;
+            return gains_select(sel.slot) ? ACK_OK : ACK_REJECTED;
+#else
+            return ACK_REJECTED;
+#endif
+        }
+
+    case FRAME_SAVE:
+        {
+            if (f->len != 0) return ACK_INVALID;
+#ifdef TUNABLE_GAINS
+            return gains_save() ? ACK_OK : ACK_REJECTED;
+#else
+            return ACK_REJECTED;
+#endif
+        }
+
+    case FRAME_TLM_RATE:
+        {
+            if (f->len != sizeof(frame_tlm_rate_t)) return ACK_INVALID;
+            frame_tlm_rate_t rate;
+            memcpy(&rate, f->payload, sizeof(rate));
+            telemetry_period_ms = rate.period_ms;
+            return ACK_OK;
+        }
+    }
+    return ACK_INVALID;
+}
+
+static void send_telemetry(uint8_t status, SYSTIM now) {
+    const balance_record_t* r = balance_last_record();
+    pose_t pose;
+    odometry_get_pose(&pose);
+
+    frame_telemetry_t t = { 0 };
+    t.time = now;
+    t.x = pose.x;
+    t.y = pose.y;
+    t.heading = pose.heading;
+    t.gyro_angle = gyro_angle;
+    t.gyro_speed = gyro_speed;
+    t.drive_target = drive_target;
+    t.steer_target = steer_target;
+    t.battery_mV = r->battery_mV;
+    t.misses = watchdog_misses > 0xFFFF ? 0xFFFF : watchdog_misses;
+    t.status = status;
+    t.load_level = load_level;
+    t.left_power = r->left_power;
+    t.right_power = r->right_power;
+#ifdef TUNABLE_GAINS
+    t.gain_slot = gains_active();
+#endif
+    t.period_ms = balance_period_ms;
+    t.margin_pct = period_info.margin_pct;
+    t.stale_pct = period_info.stale_pct;
+    send_frame(FRAME_TELEMETRY, telemetry_seq++, &t, sizeof(t));
+}
+
+void remote_poll(uint8_t status) {
+    if (in_file == NULL) return;
+
+    SYSTIM now;
+    ER ercd = get_tim(&now);
+    assert(ercd == E_OK);
+
+    while (tail != head) {
+        uint8_t byte = ring[tail % REMOTE_BUFFER_SIZE];
+        tail++;
+        for (bool_t got = frame_parse(&parser, byte); got; got = frame_next(&parser)) {
+            frame_ack_t ack = { parser.frame.type, parser.frame.seq, apply_command(&parser.frame) };
+            send_frame(FRAME_ACK, parser.frame.seq, &ack, sizeof(ack));
+            last_command_time = now;
+        }
+    }
+    remote_errors = parser.errors;
+
+    // Dead man: stop if the host goes quiet while driving
+    if (in_control && now - last_command_time >= REMOTE_TIMEOUT_MS) {
+        drive_target = 0;
+        steer_target = 0;
+        in_control = false;
+    }
+
+    if (telemetry_period_ms != 0 && now - last_telemetry_time >= telemetry_period_ms
+        && load_level < LOAD_NO_TELEMETRY) {
+        send_telemetry(status, now);
+        last_telemetry_time = now;
+    }
+}
+
+bool_t remote_in_control() {
+    return in_control;
+}
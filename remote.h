@@ -0,0 +1,49 @@
+#ifndef __REMOTE_H__
+#define __REMOTE_H__
+
+#include "ev3api.h"
+#include "frame.h"
+
+/**
+ * Binary command and telemetry link on the serial port (Bluetooth SPP on
+ * the EV3), framed as in frame.h.
+ *
+ * serial_task blocks in remote_receive, which only moves bytes into a RAM
+ * ring buffer. main_task calls remote_poll, which never blocks: it parses
+ * the buffered bytes, applies each command to the setpoints, the gun or the
+ * gains, answers it with FRAME_ACK and sends telemetry when due.
+ *
+ * Setpoints set over the link hold while commands keep coming. After
+ * REMOTE_TIMEOUT_MS of silence they are zeroed and the IR remote takes over
+ * again.
+ */
+#define REMOTE_BUFFER_SIZE  256
+#define REMOTE_TIMEOUT_MS   500
+
+/**
+ * Bytes dropped because the ring buffer was full, and frames dropped by the parser.
+ */
+extern uint32_t remote_dropped;
+extern uint32_t remote_errors;
+
+/**
+ * Use in for commands and out for acks and telemetry (may be the same file).
+ */
+void remote_open(FILE* in, FILE* out);
+
+/**
+ * Block until some bytes arrive and buffer them. Returns false on end of file or an error.
+ */
+bool_t remote_receive();
+
+/**
+ * Handle the buffered commands and send telemetry if due. status goes into the telemetry.
+ */
+void remote_poll(uint8_t status);
+
+/**
+ * True while the link is driving the setpoints.
+ */
+bool_t remote_in_control();
+
+#endif // __REMOTE_H__
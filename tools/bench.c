@@ -0,0 +1,197 @@
+/**
+ * Micro-benchmark of each stage of balance_step, with ev3api stubbed.
+ *
+ * balance.c is included directly so its static stages can be timed one by
+ * one. Every stage runs WARMUP_ITERS iterations untimed, then REPEATS timed
+ * batches of BATCH_ITERS; the median batch is reported as ns/iteration and,
+ * where the kernel allows perf counters, instructions/iteration. The "stub
+ * inputs" row is the cost of feeding the stubs and is included in every
+ * other row.
+ *
+ * Usage: bench [-r repeats]
+ *
+ * `make bench-arm` builds a static ARMv5 binary for the EV3's AM1808 that
+ * runs under ev3dev, to get the numbers on the robot's CPU.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define BALANCE_BENCH  // keep the hand-tuned controller whichever one balance.c uses
+#include "../balance.c"
+
+#define WARMUP_ITERS 10000
+#define BATCH_ITERS  10000
+#define MAX_REPEATS  101
+#define NUM_INPUTS   1024 // power of two
+
+typedef struct {
+    int16_t gyro_rate;
+    int16_t battery_mV;
+    int32_t left_cnt, right_cnt;
+} bench_input_t;
+
+static bench_input_t inputs[NUM_INPUTS];
+static SYSTIM bench_time;
+static volatile float sink;
+
+static void feed(int i) {
+    const bench_input_t* in = &inputs[i & (NUM_INPUTS - 1)];
+    bench_time += 5;
+    ev3_stub.time = bench_time;
+    ev3_stub.gyro_rate = in->gyro_rate;
+    ev3_stub.battery_mV = in->battery_mV;
+    ev3_stub.counts[left_motor] = in->left_cnt;
+    ev3_stub.counts[right_motor] = in->right_cnt;
+    ev3_stub.counts[gun_motor] = bench_time * 3 / 2;
+}
+
+static void run_stub(int i) { feed(i); }
+static void run_interval(int i) { feed(i); update_interval_time(ev3_stub.time); }
+static void run_gyro(int i) { feed(i); update_gyro_data(); }
+static void run_motor(int i) { feed(i); update_motor_data(); }
+static void run_gun(int i) { feed(i); update_gun_data(); }
+static void run_battery(int i) { feed(i); sink = calculate_battery_gain(); }
+static void run_keep_balance(int i) { feed(i); keep_balance(ev3_stub.time); }
+static void run_step(int i) { feed(i); balance_step(); }
+
+static balance_state_t bench_state(int i) {
+    const bench_input_t* in = &inputs[i & (NUM_INPUTS - 1)];
+    balance_state_t x = { in->gyro_rate, in->gyro_rate * 0.01f, in->left_cnt, in->right_cnt, 100 };
+    return x;
+}
+static void run_handtuned(int i) { balance_state_t x = bench_state(i); sink = handtuned_controller.power(&x); }
+static void run_lqr(int i) { balance_state_t x = bench_state(i); sink = lqr_controller.power(&x); }
+static void run_scheduled(int i) { balance_state_t x = bench_state(i); sink = scheduled_controller.power(&x); }
+
+typedef struct {
+    const char* name;
+    void (*run)(int i);
+} stage_t;
+
+static const stage_t stages[] = {
+    { "stub inputs",            run_stub },
+    { "update_interval_time",   run_interval },
+    { "update_gyro_data",       run_gyro },
+    { "update_motor_data",      run_motor },
+    { "update_gun_data",        run_gun },
+    { "calculate_battery_gain", run_battery },
+    { "keep_balance",           run_keep_balance },
+    { "balance_step",           run_step },
+    { "power: hand-tuned",      run_handtuned },
+    { "power: LQR",             run_lqr },
+    { "power: scheduled",       run_scheduled },
+};
+
+static int perf_fd = -1;
+
+static void perf_open() {
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    perf_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    if (perf_fd >= 0)
+        ioctl(perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+}
+
+static long long perf_read() {
+    long long count = 0;
+#ifdef __linux__
+    if (perf_fd >= 0 && read(perf_fd, &count, sizeof(count)) != sizeof(count))
+        count = 0;
+#endif
+    return count;
+}
+
+static double now_ns() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void reset() {
+    balance_reset();
+    // balance_reset only builds the gain schedule with USE_SCHEDULED_CONTROLLER
+    const float base[NUM_GAINS] = { KGYROSPEED, KGYROANGLE, KPOS, KSPEED, KDRIVE };
+    gain_schedule_init(base);
+    gyro_offset = 0.5f;
+    balance_start();
+    bench_time = 0;
+    feed(0);
+    balance_step(); // leave loop_count past the reset iteration
+}
+
+static void bench(const stage_t* s, int repeats) {
+    double ns[MAX_REPEATS], instr[MAX_REPEATS];
+
+    reset();
+    for (int i = 0; i < WARMUP_ITERS; i++)
+        s->run(i);
+
+    for (int r = 0; r < repeats; r++) {
+        reset();
+        long long i0 = perf_read();
+        double t0 = now_ns();
+        for (int i = 0; i < BATCH_ITERS; i++)
+            s->run(i);
+        double t1 = now_ns();
+        long long i1 = perf_read();
+        ns[r] = (t1 - t0) / BATCH_ITERS;
+        instr[r] = (double)(i1 - i0) / BATCH_ITERS;
+    }
+    qsort(ns, repeats, sizeof(double), compare_double);
+    qsort(instr, repeats, sizeof(double), compare_double);
+
+    if (perf_fd >= 0)
+        printf("%-24s %8.1f ns  (min %7.1f)  %7.1f instr\n", s->name, ns[repeats / 2], ns[0], instr[repeats / 2]);
+    else
+        printf("%-24s %8.1f ns  (min %7.1f)      n/a\n", s->name, ns[repeats / 2], ns[0]);
+}
+
+int main(int argc, char** argv) {
+    int repeats = 21;
+    if (argc == 3 && !strcmp(argv[1], "-r"))
+        repeats = atoi(argv[2]);
+    if (repeats < 1 || repeats > MAX_REPEATS) {
+        fprintf(stderr, "usage: %s [-r repeats (1..%d)]\n", argv[0], MAX_REPEATS);
+        return 2;
+    }
+
+    // Inputs that keep the robot near upright and moving slowly, with sensor noise
+    srand(1);
+    int32_t cnt = 0;
+    for (int i = 0; i < NUM_INPUTS; i++) {
+        cnt += rand() % 5 - 2;
+        inputs[i].gyro_rate = rand() % 9 - 4;
+        inputs[i].battery_mV = 7400 + rand() % 200;
+        inputs[i].left_cnt = cnt + rand() % 3;
+        inputs[i].right_cnt = cnt - rand() % 3;
+    }
+
+    // A burst that never ends, so update_gun_data always computes the feedforward
+    gun_direction = 1;
+    gun_target = INT32_MAX;
+
+    perf_open();
+    printf("%d x %d iterations per stage, median of %d\n", repeats, BATCH_ITERS, repeats);
+    for (int i = 0; i < sizeof(stages) / sizeof(stages[0]); i++)
+        bench(&stages[i], repeats);
+    return 0;
+}
@@ -0,0 +1,364 @@
+/**
+ * The binary command and telemetry link (remote.c, frame.h) over a
+ * pseudo-terminal standing in for the Bluetooth port.
+ *
+ * With no arguments a stand-in robot is forked on the master side of a new
+ * pty: the real remote.c, gun.c and balance_step running on the simulated
+ * robot (sim.c) in real time, with a reader thread in place of serial_task
+ * and remote_poll every 10 ms as in main_task. The client drives it through
+ * the slave side with a short script (telemetry on, drive, steer, fire,
+ * A/B gains, a corrupted frame, a frame missing a byte, going silent),
+ * prints the telemetry and reports the time from sending each command to
+ * receiving its ack.
+ *
+ * -r only runs the stand-in and prints the pty to connect to. -c port runs
+ * the script against any port, such as the robot's Bluetooth rfcomm device.
+ *
+ * Usage: btlink [-r | -c port]
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include "ev3api.h"
+#include "balance.h"
+#include "gains.h"
+#include "gun.h"
+#include "odometry.h"
+#include "remote.h"
+#include "sim.h"
+
+#define MAIN_PERIOD_MS  10  // main_task loop
+#define HOLD_RESEND_MS  200 // setpoints are sent again this often, well inside REMOTE_TIMEOUT_MS
+#define ACK_TIMEOUT_MS  500
+#define MAX_LATENCIES   256
+
+enum { RUNNING_STATUS = 2, KNOCK_OUT_STATUS = 3 }; // gyrohunter_status_t in app.c
+
+static double now_ms() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000.0 + t.tv_nsec / 1e6;
+}
+
+/*
+ * Stand-in robot
+ */
+
+static void* reader(void* unused) {
+    while (remote_receive())
+        ;
+    return NULL;
+}
+
+static void run_robot(int fd) {
+    remote_open(fdopen(fd, "rb"), fdopen(dup(fd), "wb"));
+    pthread_t thread;
+    pthread_create(&thread, NULL, reader, NULL);
+
+    sim_config_t config;
+    sim_default_config(&config);
+    sim_t sim;
+    sim_init(&sim, &config, 0, 1);
+    gun_reset();
+    gun_arm();
+    gains_init();
+    if (gains_load())
+        fprintf(stderr, "stand-in: gains slot %c from %s\n", 'A' + gains_active(), GAINS_PATH);
+
+    uint8_t status = RUNNING_STATUS;
+    int since_poll = 0;
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (;;) {
+        gains_tick();
+        if (status == RUNNING_STATUS && !sim_tick(&sim)) {
+            status = KNOCK_OUT_STATUS;
+            gun_reset();
+        }
+        if (status != RUNNING_STATUS)
+            ev3_stub.time += config.period_ms;
+        else
+            ev3_stub.time = sim.time_ms;
+
+        since_poll += config.period_ms;
+        if (since_poll >= MAIN_PERIOD_MS) {
+            since_poll = 0;
+            gun_update();
+            remote_poll(status);
+        }
+
+        next.tv_nsec += config.period_ms * 1000000L;
+        if (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+}
+
+static int open_pty(char* slave_name, size_t size) {
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+        perror("posix_openpt");
+        exit(1);
+    }
+    snprintf(slave_name, size, "%s", ptsname(master));
+
+    // Raw bytes both ways, as on the Bluetooth port. The slave stays open
+    // so that the master does not see a hangup between clients.
+    int slave = open(slave_name, O_RDWR | O_NOCTTY);
+    struct termios tio;
+    tcgetattr(slave, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slave, TCSANOW, &tio);
+    return master;
+}
+
+static pid_t start_robot(int master) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        run_robot(master);
+        _exit(0);
+    } else if (pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    return pid;
+}
+
+/*
+ * Client
+ */
+
+typedef struct {
+    int fd;
+    frame_parser_t parser;
+    uint8_t seq;
+    int sent, acked, rejected;
+    int telemetry;
+    double last_print_ms;
+    double latency[MAX_LATENCIES];
+    int latencies;
+} client_t;
+
+static const char* ack_names[] = { "ok", "rejected", "invalid" };
+
+static void print_telemetry(client_t* c, const frame_telemetry_t* t) {
+    c->telemetry++;
+    double now = now_ms();
+    if (now - c->last_print_ms < 500)
+        return;
+    c->last_print_ms = now;
+    printf("  %6u ms  tilt %5.1f deg  drive %4d steer %4d  at %5d,%5d mm %4d deg  power %4d %4d  %u mV  status %u load %u gains %c  period %u ms %d%% stale %u%%\n",
+           t->time, t->gyro_angle, t->drive_target, t->steer_target,
+           (int)ODOMETRY_MM(t->x), (int)ODOMETRY_MM(t->y), (int)ODOMETRY_DEG(t->heading),
+           t->left_power, t->right_power, t->battery_mV, t->status, t->load_level, 'A' + t->gain_slot,
+           t->period_ms, t->margin_pct, t->stale_pct);
+}
+
+/**
+ * Print telemetry, and set status if f is the ack for seq.
+ */
+static void handle_frame(client_t* c, const frame_t* f, int seq, int* status) {
+    if (f->type == FRAME_TELEMETRY && f->len == sizeof(frame_telemetry_t)) {
+        frame_telemetry_t t;
+        memcpy(&t, f->payload, sizeof(t));
+        print_telemetry(c, &t);
+    } else if (f->type == FRAME_ACK && f->len == sizeof(frame_ack_t)) {
+        frame_ack_t ack;
+        memcpy(&ack, f->payload, sizeof(ack));
+        if (seq >= 0 && ack.seq == seq)
+            *status = ack.status;
+    }
+}
+
+/**
+ * Handle incoming frames until the ack for seq (or any, if seq < 0 never) or until_ms.
+ * Returns the ack status, or -1 on timeout.
+ */
+static int pump(client_t* c, double until_ms, int seq) {
+    for (;;) {
+        double left = until_ms - now_ms();
+        if (left <= 0)
+            return -1;
+        struct pollfd pfd = { c->fd, POLLIN, 0 };
+        if (poll(&pfd, 1, (int)ceil(left)) <= 0)
+            continue;
+
+        uint8_t buf[256];
+        ssize_t n = read(c->fd, buf, sizeof(buf));
+        if (n <= 0)
+            return -1;
+        int status = -1;
+        for (ssize_t i = 0; i < n; i++)
+            for (bool_t got = frame_parse(&c->parser, buf[i]); got; got = frame_next(&c->parser))
+                handle_frame(c, &c->parser.frame, seq, &status);
+        if (status >= 0)
+            return status;
+    }
+}
+
+static int command(client_t* c, const char* name, uint8_t type, const void* payload, uint8_t len, int verbose) {
+    uint8_t buf[FRAME_MAX_SIZE];
+    uint8_t seq = c->seq++;
+    int n = frame_encode(buf, type, seq, payload, len);
+    double t0 = now_ms();
+    if (write(c->fd, buf, n) != n) {
+        perror("write");
+        exit(1);
+    }
+    c->sent++;
+
+    int status = pump(c, t0 + ACK_TIMEOUT_MS, seq);
+    double latency = now_ms() - t0;
+    if (status < 0) {
+        printf("%s: no ack\n", name);
+        return status;
+    }
+    c->acked++;
+    c->rejected += status != ACK_OK;
+    if (c->latencies < MAX_LATENCIES)
+        c->latency[c->latencies++] = latency;
+    if (verbose)
+        printf("%s: %s in %.1f ms\n", name, ack_names[status], latency);
+    return status;
+}
+
+static void set_telemetry(client_t* c, int period_ms) {
+    frame_tlm_rate_t rate = { period_ms };
+    char name[32];
+    sprintf(name, "telemetry %d ms", period_ms);
+    command(c, name, FRAME_TLM_RATE, &rate, sizeof(rate), 1);
+}
+
+/**
+ * Drive with these setpoints for ms, sending them every HOLD_RESEND_MS.
+ */
+static void hold(client_t* c, int drive, int steer, int ms) {
+    printf("drive %d steer %d for %d ms\n", drive, steer, ms);
+    double end = now_ms() + ms;
+    while (now_ms() < end) {
+        double next = now_ms() + HOLD_RESEND_MS;
+        frame_setpoint_t d = { drive }, s = { steer };
+        command(c, "drive", FRAME_DRIVE, &d, sizeof(d), 0);
+        command(c, "steer", FRAME_STEER, &s, sizeof(s), 0);
+        pump(c, next < end ? next : end, -1);
+    }
+}
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static int run_client(int fd) {
+    client_t c;
+    memset(&c, 0, sizeof(c));
+    c.fd = fd;
+    frame_parser_init(&c.parser);
+
+    set_telemetry(&c, 50);
+    hold(&c, 0, 0, 1000);
+    hold(&c, 300, 0, 2000);
+
+    frame_fire_t fire = { 1 };
+    command(&c, "fire", FRAME_FIRE, &fire, sizeof(fire), 1);
+    command(&c, "fire again at once", FRAME_FIRE, &fire, sizeof(fire), 1);
+    hold(&c, 300, 85, 1500);
+
+    // Half KPOS in slot B, drive on it for a while, then back to A and save both
+    frame_gains_t gains = { { KGYROANGLE, KGYROSPEED, KPOS / 2, KSPEED, KGUN }, 1 };
+    frame_select_t a = { 0 }, b = { 1 };
+    command(&c, "gains B", FRAME_GAINS, &gains, sizeof(gains), 1);
+    frame_gains_t nan_gains = gains;
+    nan_gains.gains.kpos = NAN;
+    command(&c, "NaN gains B", FRAME_GAINS, &nan_gains, sizeof(nan_gains), 1);
+    command(&c, "select B", FRAME_SELECT, &b, sizeof(b), 1);
+    hold(&c, 300, 0, 1000);
+    command(&c, "select A", FRAME_SELECT, &a, sizeof(a), 1);
+    command(&c, "save", FRAME_SAVE, NULL, 0, 1);
+
+    // A frame with a bad CRC is dropped and the next one still gets through
+    uint8_t bad[FRAME_MAX_SIZE];
+    frame_setpoint_t fast = { MAX_SPEED };
+    int n = frame_encode(bad, FRAME_DRIVE, c.seq++, &fast, sizeof(fast));
+    bad[n - 1] ^= 0xFF;
+    if (write(fd, bad, n) != n)
+        perror("write");
+    printf("corrupted drive %d sent\n", MAX_SPEED);
+    hold(&c, 0, 0, 1500);
+
+    // A frame that lost a byte swallows the start of the next one, which must still get through
+    n = frame_encode(bad, FRAME_DRIVE, c.seq++, &fast, sizeof(fast));
+    memmove(&bad[4], &bad[5], n - 5);
+    if (write(fd, bad, n - 1) != n - 1)
+        perror("write");
+    printf("drive %d with a byte lost sent\n", MAX_SPEED);
+    frame_setpoint_t stop = { 0 };
+    if (command(&c, "drive 0 right after it", FRAME_DRIVE, &stop, sizeof(stop), 1) != ACK_OK)
+        printf("the frame after the lost byte was lost too\n");
+    hold(&c, 0, 0, 500);
+
+    // The robot stops by itself when the commands stop
+    hold(&c, 200, 0, 1000);
+    printf("silent for %d ms\n", 2 * REMOTE_TIMEOUT_MS);
+    pump(&c, now_ms() + 2 * REMOTE_TIMEOUT_MS, -1);
+    set_telemetry(&c, 0);
+
+    qsort(c.latency, c.latencies, sizeof(double), compare_double);
+    printf("\n%d commands, %d acked, %d rejected, %d telemetry frames, %u bad frames\n",
+           c.sent, c.acked, c.rejected, c.telemetry, c.parser.errors);
+    if (c.latencies > 0)
+        printf("ack latency min %.1f  median %.1f  p95 %.1f  max %.1f ms\n",
+               c.latency[0], c.latency[c.latencies / 2],
+               c.latency[(int)(c.latencies * 0.95)], c.latency[c.latencies - 1]);
+    return c.acked == c.sent ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+    char slave_name[64];
+
+    if (argc == 2 && !strcmp(argv[1], "-r")) {
+        int master = open_pty(slave_name, sizeof(slave_name));
+        printf("stand-in robot on %s\n", slave_name);
+        fflush(stdout);
+        run_robot(master);
+        return 0;
+    }
+
+    if (argc == 3 && !strcmp(argv[1], "-c")) {
+        int fd = open(argv[2], O_RDWR | O_NOCTTY);
+        if (fd < 0) {
+            perror(argv[2]);
+            return 1;
+        }
+        struct termios tio;
+        if (tcgetattr(fd, &tio) == 0) {
+            cfmakeraw(&tio);
+            tcsetattr(fd, TCSANOW, &tio);
+        }
+        return run_client(fd);
+    }
+
+    if (argc != 1) {
+        fprintf(stderr, "usage: %s [-r | -c port]\n", argv[0]);
+        return 2;
+    }
+
+    int master = open_pty(slave_name, sizeof(slave_name));
+    pid_t robot = start_robot(master);
+    printf("stand-in robot on %s\n\n", slave_name);
+    int result = run_client(open(slave_name, O_RDWR | O_NOCTTY));
+    kill(robot, SIGTERM);
+    waitpid(robot, NULL, 0);
+    return result;
+}
@@ -0,0 +1,274 @@
+/**
+ * Choose the fall prediction parameters (FALL_PARAMS, fall.h) for a
+ * false-positive budget.
+ *
+ * Runs are collected with prediction off, so the FALL_TIME_MS rule decides
+ * when balance_step gives up, and every candidate is then played over the
+ * same traces:
+ *   - simulated pushes of random size, standing and driving, with the body
+ *     coming to rest on the floor when it falls (sim.c, plant.c)
+ *   - any recordings given on the command line, replayed through balance_step
+ *     as tools/replay does (recfile.c)
+ * A run that fell is one that hit the floor or ended with balance_step
+ * giving up. Predicting a fall in any other run is a false positive. For
+ * runs that fell, the report gives how long after the body passed 45 deg
+ * the motors were cut (simulated), and how much sooner than the
+ * FALL_TIME_MS rule (both).
+ *
+ * Usage: fallcheck [-n runs] [-b budget] [file.rec ...]
+ * budget is the number of false positives allowed over all runs (default 0).
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ev3api.h"
+#include "balance.h"
+#include "recfile.h"
+#include "sim.h"
+
+#define FLOOR_DEG 80.0
+#define RUN_S     4.0
+#define TIE_MS    20.0
+
+typedef struct {
+    SYSTIM time;
+    float angle, speed;
+    int power;
+} trace_tick_t;
+
+typedef struct {
+    trace_tick_t* ticks;
+    int count;
+    int fell;
+    int simulated;
+    SYSTIM down_time;  // simulated: body past 45 deg
+    SYSTIM cut_time;   // balance_step gave up (FALL_TIME_MS), or the end of the run
+} trace_t;
+
+typedef struct {
+    fall_params_t p;
+    int false_positives;
+    int missed;          // fell, but not predicted before the FALL_TIME_MS rule
+    double latency_ms;   // mean over simulated falls, from down_time to the cut
+    double saved_ms;     // mean over all falls, cut_time minus the predicted cut
+} candidate_t;
+
+static trace_t* traces;
+static int num_traces, cap_traces;
+
+static trace_t* new_trace(int simulated) {
+    if (num_traces == cap_traces) {
+        cap_traces = cap_traces ? cap_traces * 2 : 256;
+        traces = realloc(traces, cap_traces * sizeof(trace_t));
+    }
+    trace_t* t = &traces[num_traces++];
+    memset(t, 0, sizeof(*t));
+    t->simulated = simulated;
+    return t;
+}
+
+static void push_tick(trace_t* t, int* cap) {
+    if (t->count == *cap) {
+        *cap = *cap ? *cap * 2 : 1024;
+        t->ticks = realloc(t->ticks, *cap * sizeof(trace_tick_t));
+    }
+    const balance_record_t* r = balance_last_record();
+    trace_tick_t* k = &t->ticks[t->count++];
+    k->time = r->time;
+    k->angle = gyro_angle;
+    k->speed = gyro_speed;
+    k->power = r->power;
+}
+
+/**
+ * Stand, drive, or drive and reverse hard for a second, push, and watch until RUN_S.
+ * Loop jitter and gyro drift vary from run to run.
+ */
+static void simulate(int runs) {
+    sim_config_t config;
+    sim_default_config(&config);
+    config.floor_deg = FLOOR_DEG;
+
+    for (int r = 0; r < runs; r++) {
+        sim_t sim;
+        sim_init(&sim, &config, 0, 5000 + r);
+        sim.config.jitter_ms = (int)(3 * sim_random(&sim));
+        sim.config.bias_drift = 0.1 * (2 * sim_random(&sim) - 1);
+        trace_t* t = new_trace(1);
+        int cap = 0;
+
+        int mode = r % 3;
+        drive_target = mode ? 600 : 0;
+        int n = (int)(RUN_S * 1000 / config.period_ms), push = 1000 / config.period_ms;
+        double size = 40 + 210 * sim_random(&sim);
+        for (int i = 0; i < n; i++) {
+            if (i == push) {
+                sim_push(&sim, sim_random(&sim) < 0.5 ? size : -size);
+                if (mode == 2)
+                    drive_target = -600;
+            }
+            int up = sim_tick(&sim);
+            if (up || balance_last_record()->flags & RECORD_FALLEN)
+                push_tick(t, &cap);
+            double tilt = fabs(sim_tilt_deg(&sim));
+            if (tilt > SIM_FALL_ANGLE_DEG && t->down_time == 0)
+                t->down_time = sim.time_ms;
+            // Once balance_step gives up the robot goes down anyway
+            if (tilt >= FLOOR_DEG - 0.1 || !up)
+                t->fell = 1;
+            if (!up)
+                break;
+        }
+        t->cut_time = t->count ? t->ticks[t->count - 1].time : 0;
+    }
+}
+
+/**
+ * Replay each run of a recording through balance_step.
+ */
+static int load_recording(const char* path) {
+    size_t count;
+    balance_record_t* records = recfile_load(path, &count);
+    if (records == NULL)
+        return 0;
+
+    trace_t* t = NULL;
+    int cap = 0;
+    for (size_t i = 0; i < count; i++) {
+        const balance_record_t* r = &records[i];
+        if (r->flags & RECORD_START) {
+            recfile_start(r);
+            t = new_trace(0);
+            cap = 0;
+            continue;
+        }
+        if (r->flags & RECORD_GAINS) {
+            recfile_gains(r);
+            continue;
+        }
+        if (t == NULL || (r->flags & RECORD_GAP)) {
+            t = NULL;
+            continue;
+        }
+
+        recfile_step(r);
+        push_tick(t, &cap);
+        t->cut_time = r->time;
+        if (r->flags & RECORD_FALLEN) {
+            t->fell = 1;
+            t = NULL;
+        }
+    }
+    free(records);
+    return 1;
+}
+
+static void evaluate(candidate_t* c) {
+    int falls = 0, sim_falls = 0;
+    c->false_positives = c->missed = 0;
+    c->latency_ms = c->saved_ms = 0;
+
+    for (int i = 0; i < num_traces; i++) {
+        const trace_t* t = &traces[i];
+        if (t->count == 0)
+            continue;
+        fall_detector_t d;
+        fall_reset(&d, t->ticks[0].time);
+        SYSTIM cut = t->cut_time;
+        int predicted = 0;
+        for (int k = 0; k < t->count; k++) {
+            const trace_tick_t* tk = &t->ticks[k];
+            if (fall_predict(&d, &c->p, tk->angle, tk->speed, tk->power, tk->time)) {
+                cut = tk->time;
+                predicted = 1;
+                break;
+            }
+        }
+        if (!t->fell) {
+            c->false_positives += predicted;
+            continue;
+        }
+        falls++;
+        c->missed += !predicted;
+        c->saved_ms += (double)t->cut_time - cut;
+        if (t->simulated && t->down_time) {
+            sim_falls++;
+            c->latency_ms += (double)cut - t->down_time;
+        }
+    }
+    if (falls) c->saved_ms /= falls;
+    if (sim_falls) c->latency_ms /= sim_falls;
+}
+
+static void print_candidate(const char* label, const candidate_t* c) {
+    printf("%-6s %4.0f deg %4.2f s %4u ms | %3d %4d | %7.0f ms %7.0f ms\n", label, c->p.angle, c->p.horizon,
+           (unsigned)c->p.sat_ms, c->false_positives, c->missed, c->latency_ms, c->saved_ms);
+}
+
+int main(int argc, char** argv) {
+    int runs = 400, budget = 0;
+    int i;
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc)
+            runs = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-b") && i + 1 < argc)
+            budget = atoi(argv[++i]);
+        else
+            runs = -1, i = argc;
+    }
+    if (runs < 0 || budget < 0) {
+        fprintf(stderr, "usage: %s [-n runs] [-b budget] [file.rec ...]\n", argv[0]);
+        return 2;
+    }
+
+    // Collect the traces with prediction off
+    const fall_params_t current = FALL_PARAMS;
+    FALL_PARAMS.angle = INFINITY;
+    simulate(runs);
+    for (; i < argc; i++)
+        if (!load_recording(argv[i]))
+            return 2;
+    FALL_PARAMS = current;
+
+    int falls = 0, sim_traces = 0;
+    for (int k = 0; k < num_traces; k++) {
+        falls += traces[k].fell;
+        sim_traces += traces[k].simulated;
+    }
+    printf("%d runs (%d simulated, %d recorded), %d fell\n\n", num_traces, sim_traces, num_traces - sim_traces, falls);
+    printf("       angle    horizon  sat     |  fp miss | latency    saved\n");
+
+    candidate_t now = { current };
+    evaluate(&now);
+    print_candidate("now", &now);
+
+    static const float angles[] = { 15, 20, 25, 30, 35, 40, 45, 50, 60 };
+    static const float horizons[] = { 0, 0.05f, 0.1f, 0.2f, 0.3f };
+    static const uint32_t sats[] = { 0, 10, 20, 50, 100, 200 };
+    candidate_t best = { { 0 } };
+    int found = 0;
+    // From the most cautious candidate to the most eager
+    for (int a = sizeof(angles) / sizeof(angles[0]) - 1; a >= 0; a--)
+    for (int h = 0; h < sizeof(horizons) / sizeof(horizons[0]); h++)
+    for (int s = sizeof(sats) / sizeof(sats[0]) - 1; s >= 0; s--) {
+        candidate_t c = { { angles[a], horizons[h], sats[s] } };
+        evaluate(&c);
+        if (c.false_positives > budget)
+            continue;
+        // Fastest cut within budget, unless a more cautious candidate is within TIE_MS of it
+        if (!found || c.saved_ms > best.saved_ms + TIE_MS) {
+            best = c;
+            found = 1;
+        }
+    }
+    if (!found) {
+        printf("\nno candidate within %d false positives\n", budget);
+        return 1;
+    }
+    print_candidate("best", &best);
+
+    printf("\n/* tools/fallcheck -b %d: paste into balance.c */\n", budget);
+    printf("TUNABLE fall_params_t FALL_PARAMS = { %.1ff, %.2ff, %u };\n", best.p.angle, best.p.horizon,
+           (unsigned)best.p.sat_ms);
+    return 0;
+}
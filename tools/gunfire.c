@@ -0,0 +1,99 @@
+/**
+ * Firing while driving, with and without the gun reaction feedforward.
+ *
+ * The robot drives at full speed while the fire buttons are pressed every
+ * lockout ms, each time in a random direction. The real gun module (gun.c)
+ * decides which presses fire, balance_step runs against the nonlinear model
+ * with the gun rotor (sim.c, plant.c), and the report gives falls and how far
+ * the tilt strays from where it was before the first shot.
+ *
+ * Usage: gunfire [-r runs]
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ev3api.h"
+#include "balance.h"
+#include "gun.h"
+#include "sim.h"
+
+typedef struct {
+    int falls;
+    int shots;
+    double peak_deg;  // worst over all runs
+    double rms_deg;   // mean over the runs that stayed up
+} gunfire_result_t;
+
+static void run(int lockout_ms, int runs, gunfire_result_t* res) {
+    sim_config_t config;
+    sim_default_config(&config);
+    memset(res, 0, sizeof(*res));
+    int up = 0;
+
+    for (int r = 0; r < runs; r++) {
+        sim_t sim;
+        sim_init(&sim, &config, 0, 100 + r);
+        gun_reset();
+        gun_arm();
+
+        // Stand, then get up to full speed and measure the tilt it drives at
+        int i, n = 3000 / config.period_ms, fell = 0;
+        double base = 0;
+        drive_target = MAX_SPEED;
+        for (i = 0; i < n && !fell; i++) {
+            fell = !sim_tick(&sim);
+            if (i >= n - 1000 / config.period_ms)
+                base += sim_tilt_deg(&sim) / (1000 / config.period_ms);
+        }
+
+        // Fire for 8 s
+        n = 8000 / config.period_ms;
+        uint32_t next_press = sim.time_ms;
+        double sq = 0;
+        for (i = 0; i < n && !fell; i++) {
+            if (sim.time_ms >= next_press) {
+                res->shots += gun_fire(sim_random(&sim) < 0.5 ? 1 : -1);
+                next_press += lockout_ms;
+            }
+            gun_update();
+            fell = !sim_tick(&sim);
+            double err = fabs(sim_tilt_deg(&sim) - base);
+            if (err > res->peak_deg) res->peak_deg = err;
+            sq += err * err;
+        }
+        if (fell) {
+            res->falls++;
+        } else {
+            res->rms_deg += sqrt(sq / n);
+            up++;
+        }
+    }
+    if (up > 0)
+        res->rms_deg /= up;
+}
+
+int main(int argc, char** argv) {
+    static const int lockouts[] = { 2000, 1000, 500 };
+    int runs = 8;
+
+    if (argc == 3 && !strcmp(argv[1], "-r"))
+        runs = atoi(argv[2]);
+    if (runs < 1) {
+        fprintf(stderr, "usage: %s [-r runs]\n", argv[0]);
+        return 2;
+    }
+
+    const float kgun = KGUN;
+    printf("%d runs at drive %d, KGUN %g\n\n", runs, MAX_SPEED, kgun);
+    printf("lockout  feedforward | shots  falls | tilt error rms   peak\n");
+    for (int l = 0; l < sizeof(lockouts) / sizeof(lockouts[0]); l++) {
+        for (int ff = 0; ff < 2; ff++) {
+            gunfire_result_t res;
+            KGUN = ff ? kgun : 0;
+            run(lockouts[l], runs, &res);
+            printf("%4d ms  %-11s | %5d  %5d | %9.2f deg %6.2f deg\n", lockouts[l], ff ? "on" : "off",
+                   res.shots, res.falls, res.rms_deg, res.peak_deg);
+        }
+    }
+    return 0;
+}
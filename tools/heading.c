@@ -0,0 +1,109 @@
+/**
+ * Heading control on the plant model: how straight the robot drives with
+ * mismatched motors, and how well the yaw rate follows the steer setpoint.
+ *
+ * Straight runs drive for 8 s with the right motor IMBALANCE stronger than
+ * the left and report the heading and sideways drift at the end. Turn runs
+ * hold a steer setpoint for 5 s and compare the yaw rate over the last 3 s
+ * with what the setpoint asks for.
+ *
+ * Usage: heading [-i imbalance]
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ev3api.h"
+#include "balance.h"
+#include "sim.h"
+
+#define RAD2DEG (180.0 / M_PI)
+
+typedef struct {
+    double x, y;         // m
+    double heading_deg;
+    double yaw_rate_dps; // mean over the measured window
+} heading_result_t;
+
+static double yaw(const sim_t* s) {
+    const plant_params_t* p = &s->config.plant;
+    return s->state.delta * 2 * p->wheel_radius / p->track_width;
+}
+
+/**
+ * Run for seconds with the given setpoints, measuring the yaw rate from measure_from seconds on.
+ * Returns 0 if the robot fell.
+ */
+static int run(const sim_config_t* config, int drive, int steer, double seconds, double measure_from,
+               heading_result_t* res) {
+    sim_t sim;
+    sim_init(&sim, config, 0, 7);
+    memset(res, 0, sizeof(*res));
+
+    // Stand for a second first
+    for (int i = 0; i < 1000 / config->period_ms; i++)
+        if (!sim_tick(&sim)) return 0;
+
+    drive_target = drive;
+    steer_target = steer;
+    double yaw0 = yaw(&sim), x = 0, y = 0, t = 0, yaw_from = 0;
+    int n = (int)(seconds * 1000 / config->period_ms);
+    for (int i = 0; i < n; i++) {
+        if (!sim_tick(&sim)) return 0;
+        double dt = config->period_ms / 1000.0, phi = yaw(&sim) - yaw0;
+        double v = sim.state.theta_dot * config->plant.wheel_radius;
+        x += v * cos(phi) * dt;
+        y += v * sin(phi) * dt;
+        t += dt;
+        if (t <= measure_from)
+            yaw_from = phi;
+    }
+    res->x = x;
+    res->y = y;
+    res->heading_deg = (yaw(&sim) - yaw0) * RAD2DEG;
+    res->yaw_rate_dps = (yaw(&sim) - yaw0 - yaw_from) * RAD2DEG / (t - measure_from);
+    return 1;
+}
+
+int main(int argc, char** argv) {
+    double imbalance = 0.05;
+    if (argc == 3 && !strcmp(argv[1], "-i"))
+        imbalance = atof(argv[2]);
+    else if (argc != 1) {
+        fprintf(stderr, "usage: %s [-i imbalance]\n", argv[0]);
+        return 2;
+    }
+
+    sim_config_t config;
+    sim_default_config(&config);
+    config.plant.motor_imbalance = imbalance;
+    heading_result_t res;
+
+    printf("Straight, 8 s, right motor %+.0f%%\n", imbalance * 100);
+    printf("drive | distance  heading  sideways\n");
+    static const int drives[] = { 150, 300, 600 };
+    for (int i = 0; i < 3; i++) {
+        if (!run(&config, drives[i], 0, 8.0, 0, &res))
+            printf("%5d | fell\n", drives[i]);
+        else
+            printf("%5d | %6.2f m %6.1f deg %5.0f mm\n", drives[i], res.x, res.heading_deg, res.y * 1000);
+    }
+
+    // motor_diff counts per second to robot yaw rate
+    const plant_params_t* p = &config.plant;
+    double dps_per_steer = p->wheel_radius / p->track_width;
+
+    printf("\nTurn, 5 s, yaw rate over the last 3 s\n");
+    printf("drive  steer | asked     got\n");
+    static const int steers[] = { 5, 20, 85, 170 };
+    for (int d = 0; d < 2; d++) {
+        for (int i = 0; i < 4; i++) {
+            int drive = d ? 300 : 0;
+            if (!run(&config, drive, steers[i], 5.0, 2.0, &res))
+                printf("%5d  %5d | fell\n", drive, steers[i]);
+            else
+                printf("%5d  %5d | %5.1f %7.1f deg/s\n", drive, steers[i], steers[i] * dps_per_steer,
+                       res.yaw_rate_dps);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,54 @@
+/**
+ * Host stand-in for the subset of ev3api.h that the balance code uses.
+ * The stubs in ev3stub.c read their values from ev3_stub, which the tools
+ * fill in before every balance_step.
+ */
+#ifndef __HOST_EV3API_H__
+#define __HOST_EV3API_H__
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef int ER;
+typedef uint32_t SYSTIM;
+typedef uint64_t SYSUTM;
+typedef int bool_t;
+
+#define E_OK   0
+#define E_OBJ  (-41)
+
+#define LOG_ERROR   3
+#define LOG_WARNING 4
+#define LOG_NOTICE  5
+#define LOG_INFO    6
+
+typedef enum { EV3_PORT_1, EV3_PORT_2, EV3_PORT_3, EV3_PORT_4, TNUM_SENSOR_PORT } sensor_port_t;
+typedef enum { EV3_PORT_A, EV3_PORT_B, EV3_PORT_C, EV3_PORT_D, TNUM_MOTOR_PORT } motor_port_t;
+
+typedef struct {
+    SYSTIM time;
+    int16_t gyro_rate;
+    int battery_mV;
+    int32_t counts[TNUM_MOTOR_PORT];
+    int power[TNUM_MOTOR_PORT];
+    int rotate_speed[TNUM_MOTOR_PORT];     // signed speed of the last ev3_motor_rotate, 0 once it arrived
+    int32_t rotate_target[TNUM_MOTOR_PORT];
+} ev3_stub_t;
+
+extern ev3_stub_t ev3_stub;
+
+ER get_tim(SYSTIM* p_systim);
+ER get_utm(SYSUTM* p_sysutm);
+ER tslp_tsk(int32_t ms);
+void syslog(int prio, const char* format, ...);
+
+int16_t ev3_gyro_sensor_get_rate(sensor_port_t port);
+int32_t ev3_motor_get_counts(motor_port_t port);
+int ev3_battery_voltage_mV();
+ER ev3_motor_set_power(motor_port_t port, int power);
+ER ev3_motor_rotate(motor_port_t port, int degrees, uint32_t speed_abs, bool_t blocking);
+ER ev3_motor_stop(motor_port_t port, bool_t brake);
+
+#endif // __HOST_EV3API_H__
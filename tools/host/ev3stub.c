@@ -0,0 +1,73 @@
+#include <stdarg.h>
+#include "ev3api.h"
+
+ev3_stub_t ev3_stub;
+
+// Same ports as app.c
+const int gyro_sensor = EV3_PORT_2;
+const int left_motor = EV3_PORT_A;
+const int right_motor = EV3_PORT_D;
+const int gun_motor = EV3_PORT_C;
+
+ER get_tim(SYSTIM* p_systim)
+{
+    *p_systim = ev3_stub.time;
+    return E_OK;
+}
+
+ER get_utm(SYSUTM* p_sysutm)
+{
+    *p_sysutm = (SYSUTM)ev3_stub.time * 1000;
+    return E_OK;
+}
+
+ER tslp_tsk(int32_t ms)
+{
+    ev3_stub.time += ms;
+    return E_OK;
+}
+
+void syslog(int prio, const char* format, ...)
+{
+    va_list ap;
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    fputc('\n', stderr);
+    va_end(ap);
+}
+
+int16_t ev3_gyro_sensor_get_rate(sensor_port_t port)
+{
+    return ev3_stub.gyro_rate;
+}
+
+int32_t ev3_motor_get_counts(motor_port_t port)
+{
+    return ev3_stub.counts[port];
+}
+
+int ev3_battery_voltage_mV()
+{
+    return ev3_stub.battery_mV;
+}
+
+ER ev3_motor_set_power(motor_port_t port, int power)
+{
+    ev3_stub.power[port] = power;
+    return E_OK;
+}
+
+ER ev3_motor_rotate(motor_port_t port, int degrees, uint32_t speed_abs, bool_t blocking)
+{
+    // The simulation moves the motor towards rotate_target; blocking is not supported
+    ev3_stub.rotate_target[port] = ev3_stub.counts[port] + degrees;
+    ev3_stub.rotate_speed[port] = degrees < 0 ? -(int)speed_abs : (int)speed_abs;
+    return E_OK;
+}
+
+ER ev3_motor_stop(motor_port_t port, bool_t brake)
+{
+    ev3_stub.power[port] = 0;
+    ev3_stub.rotate_speed[port] = 0;
+    return E_OK;
+}
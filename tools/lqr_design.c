@@ -0,0 +1,245 @@
+/**
+ * Offline design of the discrete LQR gains used by lqr_controller (controller.c).
+ *
+ * Linearizes the plant model (plant.c) around upright, moves it into the
+ * coordinates keep_balance sees, discretizes it at the control period and
+ * solves the discrete Riccati equation. It then compares the LQR gains with
+ * a hand-tuned gain vector on the linear model: settling time from an initial
+ * tilt, and peak tilt and settling time after a push.
+ *
+ * Usage: lqr_design [-t period_s] [-k gyro_speed gyro_angle pos speed]
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "plant.h"
+
+#define N PLANT_NX
+
+// State weights on { gyro_speed, gyro_angle, motor_pos, motor_speed } and input weight
+static const double Q[N] = { 0.02, 5.0, 0.002, 0.0005 };
+static const double R = 0.1;
+
+static void mat_mul(int n, const double* a, const double* b, double* out)
+{
+    double tmp[(N + 1) * (N + 1)];
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < n; j++) {
+            double s = 0;
+            for (int k = 0; k < n; k++)
+                s += a[i * n + k] * b[k * n + j];
+            tmp[i * n + j] = s;
+        }
+    memcpy(out, tmp, sizeof(double) * n * n);
+}
+
+static int mat_inv(double a[N][N], double inv[N][N])
+{
+    double m[N][2 * N];
+    for (int i = 0; i < N; i++)
+        for (int j = 0; j < N; j++) {
+            m[i][j] = a[i][j];
+            m[i][N + j] = (i == j);
+        }
+    for (int c = 0; c < N; c++) {
+        int piv = c;
+        for (int r = c + 1; r < N; r++)
+            if (fabs(m[r][c]) > fabs(m[piv][c])) piv = r;
+        if (fabs(m[piv][c]) < 1e-12) return -1;
+        for (int j = 0; j < 2 * N; j++) {
+            double t = m[c][j]; m[c][j] = m[piv][j]; m[piv][j] = t;
+        }
+        double d = m[c][c];
+        for (int j = 0; j < 2 * N; j++) m[c][j] /= d;
+        for (int r = 0; r < N; r++) {
+            if (r == c) continue;
+            double f = m[r][c];
+            for (int j = 0; j < 2 * N; j++) m[r][j] -= f * m[c][j];
+        }
+    }
+    for (int i = 0; i < N; i++)
+        for (int j = 0; j < N; j++)
+            inv[i][j] = m[i][N + j];
+    return 0;
+}
+
+/**
+ * Zero-order-hold discretization through the exponential of { { A, B }, { 0, 0 } } * dt,
+ * by scaling and squaring a Taylor series.
+ */
+static void discretize(double A[N][N], double B[N], double dt, double Ad[N][N], double Bd[N])
+{
+    const int n = N + 1;
+    double M[(N + 1) * (N + 1)] = { 0 }, E[(N + 1) * (N + 1)] = { 0 }, term[(N + 1) * (N + 1)];
+    int squarings = 8;
+    double scale = dt / (1 << squarings);
+
+    for (int i = 0; i < N; i++) {
+        for (int j = 0; j < N; j++)
+            M[i * n + j] = A[i][j] * scale;
+        M[i * n + N] = B[i] * scale;
+    }
+    for (int i = 0; i < n; i++) E[i * n + i] = term[i * n + i] = 1;
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < n; j++)
+            if (i != j) term[i * n + j] = 0;
+    for (int k = 1; k < 20; k++) {
+        mat_mul(n, term, M, term);
+        for (int i = 0; i < n * n; i++) {
+            term[i] /= k;
+            E[i] += term[i];
+        }
+    }
+    for (int s = 0; s < squarings; s++)
+        mat_mul(n, E, E, E);
+
+    for (int i = 0; i < N; i++) {
+        for (int j = 0; j < N; j++)
+            Ad[i][j] = E[i * n + j];
+        Bd[i] = E[i * n + N];
+    }
+}
+
+/**
+ * Iterate the discrete Riccati recursion to its fixed point and return K for u = -K x.
+ */
+static int solve_dlqr(double Ad[N][N], double Bd[N], double K[N])
+{
+    double P[N][N] = { { 0 } };
+    for (int i = 0; i < N; i++) P[i][i] = Q[i];
+
+    for (int iter = 0; iter < 200000; iter++) {
+        double PB[N], PA[N][N], BtPA[N], BtPB = 0;
+        for (int i = 0; i < N; i++) {
+            PB[i] = 0;
+            for (int k = 0; k < N; k++) PB[i] += P[i][k] * Bd[k];
+            BtPB += Bd[i] * PB[i];
+        }
+        for (int i = 0; i < N; i++)
+            for (int j = 0; j < N; j++) {
+                PA[i][j] = 0;
+                for (int k = 0; k < N; k++) PA[i][j] += P[i][k] * Ad[k][j];
+            }
+        for (int j = 0; j < N; j++) {
+            BtPA[j] = 0;
+            for (int k = 0; k < N; k++) BtPA[j] += Bd[k] * PA[k][j];
+        }
+        for (int j = 0; j < N; j++) K[j] = BtPA[j] / (R + BtPB);
+
+        double delta = 0;
+        for (int i = 0; i < N; i++)
+            for (int j = 0; j < N; j++) {
+                double AtPA = 0;
+                for (int k = 0; k < N; k++) AtPA += Ad[k][i] * PA[k][j];
+                double next = (i == j ? Q[i] : 0) + AtPA - BtPA[i] * BtPA[j] / (R + BtPB);
+                delta = fmax(delta, fabs(next - P[i][j]) / (1 + fabs(next)));
+                P[i][j] = next;
+            }
+        if (delta < 1e-12) return iter;
+    }
+    return -1;
+}
+
+typedef struct {
+    int fell;
+    double settle_s;
+    double peak_deg;
+} response_t;
+
+/**
+ * Closed-loop response of power = gains . y on the discrete model, with the power
+ * saturated like keep_balance does. Settled once |gyro_angle| stays under 0.5 deg.
+ */
+static response_t simulate(double Ad[N][N], double Bd[N], const double gains[N], const double y0[N],
+                           double dt, double batt_gain)
+{
+    response_t r = { 0, 0, 0 };
+    double y[N], next[N];
+    memcpy(y, y0, sizeof(y));
+    int steps = (int)(10.0 / dt), last_out = 0;
+
+    for (int k = 0; k < steps; k++) {
+        double u = 0;
+        for (int i = 0; i < N; i++) u += gains[i] * y[i];
+        u = fmax(-100 / batt_gain, fmin(100 / batt_gain, u));
+        for (int i = 0; i < N; i++) {
+            next[i] = Bd[i] * u;
+            for (int j = 0; j < N; j++) next[i] += Ad[i][j] * y[j];
+        }
+        memcpy(y, next, sizeof(y));
+        r.peak_deg = fmax(r.peak_deg, fabs(y[1]));
+        if (fabs(y[1]) > 30) {
+            r.fell = 1;
+            break;
+        }
+        if (fabs(y[1]) > 0.5) last_out = k + 1;
+    }
+    r.settle_s = last_out * dt;
+    return r;
+}
+
+static void report(const char* name, double Ad[N][N], double Bd[N], const double gains[N], double dt, double batt_gain)
+{
+    // Initial tilt of 3 deg with the wheels at rest, then a push of 50 deg/s on the body
+    const double tilt[N] = { 0, 3, -6, 0 };
+    const double push[N] = { 50, 0, 0, -100 };
+    response_t a = simulate(Ad, Bd, gains, tilt, dt, batt_gain);
+    response_t b = simulate(Ad, Bd, gains, push, dt, batt_gain);
+
+    printf("%-10s  tilt 3deg: %s settle %.2f s   push 50deg/s: %s peak %.1f deg settle %.2f s\n", name,
+           a.fell ? "FELL" : "ok  ", a.settle_s, b.fell ? "FELL" : "ok  ", b.peak_deg, b.settle_s);
+}
+
+int main(int argc, char** argv)
+{
+    double dt = 0.005;
+    double hand[N] = { 1.4, 6.0, 0.035, 0.1 }; // Gyrohunter profile in app.c
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+            dt = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "-k") && i + N < argc) {
+            for (int j = 0; j < N; j++) hand[j] = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [-t period_s] [-k gyro_speed gyro_angle pos speed]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    plant_params_t params;
+    plant_default_params(&params);
+
+    double A[N][N], B[N], T[N][N], Ti[N][N], TA[N][N], Am[N][N], Bm[N];
+    plant_linearize(&params, A, B);
+    plant_sensor_transform(T);
+    if (mat_inv(T, Ti) != 0) {
+        fprintf(stderr, "singular sensor transform\n");
+        return 1;
+    }
+    mat_mul(N, &T[0][0], &A[0][0], &TA[0][0]);
+    mat_mul(N, &TA[0][0], &Ti[0][0], &Am[0][0]);
+    for (int i = 0; i < N; i++) {
+        Bm[i] = 0;
+        for (int j = 0; j < N; j++) Bm[i] += T[i][j] * B[j];
+    }
+
+    double Ad[N][N], Bd[N], K[N], lqr[N];
+    discretize(Am, Bm, dt, Ad, Bd);
+    if (solve_dlqr(Ad, Bd, K) < 0) {
+        fprintf(stderr, "Riccati iteration did not converge\n");
+        return 1;
+    }
+    for (int i = 0; i < N; i++) lqr[i] = -K[i];
+
+    printf("/* tools/lqr_design -t %g */\n", dt);
+    printf("static const float LQR_KGYROSPEED = %.5ff;\n", lqr[0]);
+    printf("static const float LQR_KGYROANGLE = %.5ff;\n", lqr[1]);
+    printf("static const float LQR_KPOS = %.5ff;\n", lqr[2]);
+    printf("static const float LQR_KSPEED = %.5ff;\n\n", lqr[3]);
+
+    double batt_gain = plant_battery_gain(params.battery_voltage);
+    report("lqr", Ad, Bd, lqr, dt, batt_gain);
+    report("hand", Ad, Bd, hand, dt, batt_gain);
+    return 0;
+}
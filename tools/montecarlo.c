@@ -0,0 +1,379 @@
+/**
+ * Monte Carlo robustness check of the balance gains over many simulated robots.
+ *
+ * Each parameter set (wheel diameter, battery voltage, gyro bias drift, loop
+ * jitter) is run on a few thousand robots that differ in initial gyro bias,
+ * drift direction, pushes and noise. The report gives the fall probability
+ * and the distribution of peak tilt for each set.
+ *
+ * Robots are stepped LANES at a time, structure-of-arrays, with a branch-free
+ * port of balance_step (hand-tuned law, standing still) and a float version
+ * of the plant in plant.c. Every inner loop runs over the lanes, so the
+ * compiler turns each statement into one SIMD instruction per 8 or 16 robots.
+ * The gains and constants are linked from the TUNABLE_GAINS build of
+ * balance.c, and `montecarlo -t` checks that the port sets the same power as
+ * balance_step tick for tick.
+ *
+ * Usage: montecarlo [-n robots_per_set] [-s seconds] [-t]
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ev3api.h"
+#include "balance.h"
+#include "plant.h"
+
+#define LANES 16
+
+#define RAD2DEG 57.29577951f
+#define DEG2RAD 0.01745329252f
+#define GRAVITY 9.81f
+#define FALL_ANGLE_DEG 45.0f
+
+extern const float EMAOFFSET, KDRIVE, WHEEL_DIAMETER, INIT_GYROANGLE, INIT_INTERVAL_TIME;
+extern const uint32_t FALL_TIME_MS;
+
+/**
+ * One parameter set, shared by every robot in it.
+ */
+typedef struct {
+    float wheel_diameter;  // cm
+    float battery_voltage; // V
+    float drift;           // deg/s per second, random sign per robot
+    int jitter_ms;         // 0..jitter_ms added to each loop period
+} param_set_t;
+
+/**
+ * LANES robots. Control state mirrors the globals and statics in balance.c.
+ */
+typedef struct {
+    // Plant
+    float theta[LANES], psi[LANES], theta_dot[LANES], psi_dot[LANES];
+    float e11[LANES], mlr[LANES], jm2[LANES], e22[LANES], alpha[LANES], beta[LANES], mgl[LANES];
+    float volts[LANES], bias[LANES], drift[LANES];
+
+    // Sensors
+    int32_t gyro[LANES], cnt[LANES];
+    int32_t battery_mV[LANES];
+
+    // Control
+    int32_t loop_count[LANES], start_time[LANES], ok_time[LANES], since[LANES];
+    int32_t prev_sum[LANES], d0[LANES], d1[LANES], d2[LANES], d3[LANES];
+    float gyro_offset[LANES], gyro_angle[LANES], motor_pos[LANES];
+    int32_t power[LANES];
+
+    // Scheduling and results
+    int32_t countdown[LANES], fallen[LANES];
+    uint32_t rng[LANES];
+    float peak[LANES];
+} block_t;
+
+static inline uint32_t xorshift(uint32_t x) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return x;
+}
+
+static inline float unit(uint32_t x) {
+    return (float)(x >> 8) * (1.0f / 16777216.0f);
+}
+
+static void block_init(block_t* b, const param_set_t* set, const plant_params_t* p, uint32_t seed) {
+    memset(b, 0, sizeof(*b));
+
+    float R = set->wheel_diameter / 200.0f;
+    float M = p->body_mass, L = p->body_height, m = p->wheel_mass, Jm = p->motor_inertia;
+    float Jw = m * R * R / 2, Jpsi = M * L * L / 3;
+
+    for (int l = 0; l < LANES; l++) {
+        b->e11[l] = (2 * m + M) * R * R + 2 * Jw + 2 * Jm;
+        b->mlr[l] = M * L * R;
+        b->jm2[l] = 2 * Jm;
+        b->e22[l] = M * L * L + Jpsi + 2 * Jm;
+        b->alpha[l] = p->motor_kt / p->motor_resistance;
+        b->beta[l] = p->motor_kt * p->motor_kb / p->motor_resistance + p->motor_friction;
+        b->mgl[l] = M * GRAVITY * L;
+        b->volts[l] = set->battery_voltage;
+        b->battery_mV[l] = (int32_t)(set->battery_voltage * 1000);
+
+        b->rng[l] = xorshift(seed * 2654435761u + l * 40503u + 1);
+        b->bias[l] = 2 * unit(b->rng[l]) - 1; // +-1 deg/s
+        b->rng[l] = xorshift(b->rng[l]);
+        b->drift[l] = (b->rng[l] & 1) ? set->drift : -set->drift;
+
+        // The gyro is calibrated while the robot is held still
+        b->gyro_offset[l] = b->bias[l];
+        b->gyro_angle[l] = INIT_GYROANGLE;
+        b->ok_time[l] = 0;
+        b->since[l] = 0;
+    }
+}
+
+/**
+ * One balance_step for every lane, committed only where due is set.
+ * Same arithmetic, in the same order and precision, as balance.c with the
+ * hand-tuned law, drive 0 and both wheels at the same count.
+ */
+static void control_step(block_t* restrict b, const int32_t* restrict due, int32_t now) {
+    const float ratio_wheel = WHEEL_DIAMETER / 5.6;
+    const fall_params_t fp = FALL_PARAMS;
+
+    for (int l = 0; l < LANES; l++) {
+        int32_t first = b->loop_count[l] == 0;
+        int32_t lc = b->loop_count[l] + 1;
+        int32_t start = first ? now : b->start_time[l];
+        float dt = first ? INIT_INTERVAL_TIME : ((float)(now - start)) / lc / 1000;
+
+        float g = (float)b->gyro[l];
+        float offset = EMAOFFSET * g + (1 - EMAOFFSET) * b->gyro_offset[l];
+        float speed = g - offset;
+        float angle = b->gyro_angle[l] + speed * dt;
+
+        int32_t sum = b->cnt[l] + b->cnt[l];
+        int32_t prev = lc == 1 ? 0 : b->prev_sum[l];
+        float pos0 = lc == 1 ? 0 : b->motor_pos[l];
+        int32_t delta = sum - prev;
+        float pos = pos0 + delta;
+        int32_t d0 = delta, d1 = lc == 1 ? 0 : b->d0[l], d2 = lc == 1 ? 0 : b->d1[l], d3 = lc == 1 ? 0 : b->d2[l];
+        float mspeed = (d0 + d1 + d2 + d3) / 4.0f / dt;
+
+        float gain = (float)(0.7 + ((1.12 - 0.7) / (8500 - 6500)) * (8500 - b->battery_mV[l]));
+        float law = (KGYROSPEED * speed + KGYROANGLE * angle) / ratio_wheel + KPOS * pos + KSPEED * mspeed + KDRIVE * 0.0f;
+        int32_t power = (int32_t)(law * gain);
+
+        int32_t ok_time = lc == 1 ? now : b->ok_time[l];
+        int32_t saturated = (power <= -100) | (power >= 100);
+        ok_time = saturated ? ok_time : now;
+        int32_t gave_up = saturated & ((uint32_t)(now - ok_time) >= FALL_TIME_MS);
+
+        // fall_predict
+        float ahead = angle + speed * fp.horizon;
+        int32_t pushing = ((ahead > fp.angle) & (power >= 100)) | ((ahead < -fp.angle) & (power <= -100));
+        int32_t since = lc == 1 ? now : b->since[l];
+        since = pushing ? since : now;
+        gave_up |= (uint32_t)(now - since) >= fp.sat_ms;
+        power = power > 100 ? 100 : power < -100 ? -100 : power;
+        power = gave_up ? 0 : power;
+
+        int32_t commit = due[l];
+        b->loop_count[l] = commit ? lc : b->loop_count[l];
+        b->start_time[l] = commit ? start : b->start_time[l];
+        b->gyro_offset[l] = commit ? offset : b->gyro_offset[l];
+        b->gyro_angle[l] = commit ? angle : b->gyro_angle[l];
+        b->motor_pos[l] = commit ? pos : b->motor_pos[l];
+        b->prev_sum[l] = commit ? sum : b->prev_sum[l];
+        b->d3[l] = commit ? d3 : b->d3[l];
+        b->d2[l] = commit ? d2 : b->d2[l];
+        b->d1[l] = commit ? d1 : b->d1[l];
+        b->d0[l] = commit ? d0 : b->d0[l];
+        b->ok_time[l] = commit ? ok_time : b->ok_time[l];
+        b->since[l] = commit ? since : b->since[l];
+        b->power[l] = commit ? power : b->power[l];
+        b->fallen[l] |= commit & gave_up;
+    }
+}
+
+/**
+ * 1 ms of plant for every lane (semi-implicit Euler, polynomial sin/cos up to 45 deg).
+ */
+static void plant_step_1ms(block_t* restrict b) {
+    const float dt = 0.001f;
+
+    for (int l = 0; l < LANES; l++) {
+        float x = b->psi[l], x2 = x * x;
+        float s = x * (1 - x2 / 6 * (1 - x2 / 20));
+        float c = 1 - x2 / 2 * (1 - x2 / 12);
+
+        float v = b->power[l] * 0.01f * b->volts[l];
+        float rel = b->theta_dot[l] - b->psi_dot[l];
+        float e12 = b->mlr[l] * c - b->jm2[l];
+        float f_theta = 2 * b->alpha[l] * v - 2 * b->beta[l] * rel + b->mlr[l] * b->psi_dot[l] * b->psi_dot[l] * s;
+        float f_psi = -2 * b->alpha[l] * v + 2 * b->beta[l] * rel + b->mgl[l] * s;
+        float det = b->e11[l] * b->e22[l] - e12 * e12;
+
+        // A fallen robot stays where it fell
+        float h = b->fallen[l] ? 0.0f : dt;
+        b->theta_dot[l] += h * (b->e22[l] * f_theta - e12 * f_psi) / det;
+        b->psi_dot[l] += h * (b->e11[l] * f_psi - e12 * f_theta) / det;
+        b->theta[l] += h * b->theta_dot[l];
+        b->psi[l] += h * b->psi_dot[l];
+    }
+}
+
+static void run_block(block_t* restrict b, const param_set_t* set, int seconds) {
+    int32_t due[LANES];
+
+    for (int32_t t = 0; t < seconds * 1000; t++) {
+        for (int l = 0; l < LANES; l++) {
+            // Sensors, with +-1 deg/s noise on the gyro
+            uint32_t r = xorshift(b->rng[l]);
+            b->rng[l] = r;
+            float rate = b->psi_dot[l] * RAD2DEG + b->bias[l] + (2 * unit(r) - 1);
+            b->gyro[l] = (int32_t)(rate + (rate < 0 ? -0.5f : 0.5f)); // lround
+            float enc = (b->theta[l] - b->psi[l]) * RAD2DEG;
+            int32_t cnt = (int32_t)enc;
+            b->cnt[l] = cnt - (enc < cnt); // floor
+            due[l] = (b->countdown[l] <= 0) & !b->fallen[l];
+        }
+
+        control_step(b, due, t);
+
+        for (int l = 0; l < LANES; l++) {
+            // Next period: WAIT_TIME_MS plus a tick of execution, plus jitter
+            uint32_t r = xorshift(b->rng[l]);
+            b->rng[l] = r;
+            int32_t period = WAIT_TIME_MS + 1 + (int32_t)(unit(r) * (set->jitter_ms + 1));
+            b->countdown[l] = (due[l] ? period : b->countdown[l]) - 1;
+
+            // About one push per second, up to 80 deg/s either way
+            uint32_t q = xorshift(r ^ 0x9e3779b9u);
+            float push = unit(q) < 0.001f ? (2 * unit(xorshift(q)) - 1) * 80 * DEG2RAD : 0.0f;
+            b->psi_dot[l] += push;
+
+            b->bias[l] += b->drift[l] * 0.001f;
+        }
+
+        plant_step_1ms(b);
+
+        for (int l = 0; l < LANES; l++) {
+            float tilt = fabsf(b->psi[l]) * RAD2DEG;
+            b->peak[l] = tilt > b->peak[l] ? tilt : b->peak[l];
+            b->fallen[l] |= tilt > FALL_ANGLE_DEG;
+        }
+    }
+}
+
+static int compare_float(const void* a, const void* b) {
+    float x = *(const float*)a, y = *(const float*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Feed the same random sensor stream to control_step and balance_step and compare the power.
+ */
+static int self_test() {
+    enum { TICKS = 5000 };
+    static int32_t gyro[LANES][TICKS], cnt[LANES][TICKS], expect[LANES][TICKS];
+    uint32_t rng = 12345;
+    int mismatches = 0, compared = 0;
+
+    for (int l = 0; l < LANES; l++) {
+        int32_t c = 0;
+        for (int i = 0; i < TICKS; i++) {
+            rng = xorshift(rng);
+            gyro[l][i] = (int32_t)(rng % 41) - 20;
+            c += (int32_t)((rng >> 8) % 7) - 3;
+            cnt[l][i] = c;
+        }
+
+        balance_reset();
+        gyro_offset = 0.25f * l;
+        balance_start();
+        ev3_stub.battery_mV = 7000 + 100 * l;
+        for (int i = 0; i < TICKS; i++) {
+            ev3_stub.time = 6 * i;
+            ev3_stub.gyro_rate = gyro[l][i];
+            ev3_stub.counts[left_motor] = ev3_stub.counts[right_motor] = cnt[l][i];
+            expect[l][i] = balance_step() ? balance_last_record()->left_power : 0;
+        }
+    }
+
+    block_t b;
+    param_set_t set = { 5.6f, 7.5f, 0, 0 };
+    plant_params_t p;
+    plant_default_params(&p);
+    block_init(&b, &set, &p, 1);
+    int32_t due[LANES];
+    for (int l = 0; l < LANES; l++) {
+        b.gyro_offset[l] = 0.25f * l;
+        b.battery_mV[l] = 7000 + 100 * l;
+        due[l] = 1;
+    }
+    for (int i = 0; i < TICKS; i++) {
+        for (int l = 0; l < LANES; l++) {
+            b.gyro[l] = gyro[l][i];
+            b.cnt[l] = cnt[l][i];
+            due[l] = !b.fallen[l];
+        }
+        control_step(&b, due, 6 * i);
+        for (int l = 0; l < LANES; l++) {
+            int32_t got = b.fallen[l] ? 0 : b.power[l];
+            compared += due[l];
+            if (due[l] && got != expect[l][i]) {
+                if (mismatches < 10)
+                    printf("lane %d tick %d: balance_step %d, port %d\n", l, i, expect[l][i], got);
+                mismatches++;
+            }
+        }
+    }
+    printf("%d lanes x %d ticks, %d compared before falling, %d mismatches\n", LANES, TICKS, compared, mismatches);
+    return mismatches ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+    int robots = 2048, seconds = 10;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc)
+            robots = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+            seconds = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-t"))
+            return self_test();
+        else
+            robots = 0, i = argc;
+    }
+    if (robots < LANES || seconds < 1) {
+        fprintf(stderr, "usage: %s [-n robots_per_set (>= %d)] [-s seconds] [-t]\n", argv[0], LANES);
+        return 2;
+    }
+    robots -= robots % LANES;
+
+    static const float wheels[] = { 5.4f, 5.6f, 5.8f };
+    static const float batteries[] = { 6.8f, 7.5f, 8.2f };
+    static const float drifts[] = { 0.0f, 0.05f };
+    static const int jitters[] = { 0, 3 };
+
+    plant_params_t p;
+    plant_default_params(&p);
+    float* peaks = malloc(robots * sizeof(float));
+    static block_t block __attribute__((aligned(64)));
+    block_t* b = &block;
+
+    printf("%d robots per set, %d s each, %d lanes per block\n", robots, seconds, LANES);
+    printf("wheel  batt  drift  jitter |  falls  | peak tilt p50   p95   p99\n");
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    long total = 0;
+    for (int w = 0; w < 3; w++)
+    for (int v = 0; v < 3; v++)
+    for (int d = 0; d < 2; d++)
+    for (int j = 0; j < 2; j++) {
+        param_set_t set = { wheels[w], batteries[v], drifts[d], jitters[j] };
+        int falls = 0;
+        for (int r = 0; r < robots; r += LANES) {
+            block_init(b, &set, &p, r + 1);
+            run_block(b, &set, seconds);
+            for (int l = 0; l < LANES; l++) {
+                falls += b->fallen[l] != 0;
+                peaks[r + l] = b->peak[l];
+            }
+        }
+        qsort(peaks, robots, sizeof(float), compare_float);
+        printf("%4.1f  %4.1f  %5.2f  %3d ms  | %5.1f%%  |      %5.1f %5.1f %5.1f\n", set.wheel_diameter,
+               set.battery_voltage, set.drift, set.jitter_ms, 100.0 * falls / robots,
+               peaks[robots / 2], peaks[robots * 95 / 100], peaks[robots * 99 / 100]);
+        total += robots;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    double elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("%ld robots x %d s simulated in %.1f s (%.0f robot-ms per us)\n", total, seconds, elapsed,
+           total * seconds * 1000.0 / (elapsed * 1e6));
+
+    free(peaks);
+    return 0;
+}
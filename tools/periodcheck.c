@@ -0,0 +1,186 @@
+/**
+ * Switching the control period mid-run on the plant model.
+ *
+ * Each run balances for SETTLE_S at WAIT_TIME_MS, switches to a shorter wait
+ * (sim_set_period, as period.c does after it has timed the loop), takes a
+ * push PUSH_DPS after PUSH_AFTER_S and runs on for RUN_S. A second switch
+ * one millisecond back up, as a watchdog back-off, follows halfway. The
+ * report gives the worst interval_time error over the loops after each
+ * switch, against the loop the simulation really runs, and the peak tilt
+ * after the push, next to the same runs that stay at WAIT_TIME_MS.
+ *
+ * Then period.c itself runs the loop, with a gyro that takes a new sample
+ * only every so many milliseconds. Its probe polls the gyro in real time and
+ * cannot run here, so each run takes it to have timed SENSOR_US, faster than
+ * the slower gyros really are. The report gives the wait each run ends on,
+ * the back-offs and the largest share of gyro repeats over the one at
+ * WAIT_TIME_MS. No run should end on a loop that reads the same sample every
+ * other time, at half the gyro's interval or less (period.h).
+ *
+ * Usage: periodcheck [-n runs]
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ev3api.h"
+#include "balance.h"
+#include "gyro.h"
+#include "period.h"
+#include "sim.h"
+
+#define SETTLE_S      2.0
+#define PUSH_AFTER_S  0.5
+#define PUSH_DPS      60.0
+#define RUN_S         3.0
+#define CHECK_LOOPS   20   // loops after a switch whose interval_time is checked
+#define ADAPT_S       10.0
+#define SENSOR_US     1000 // what the probe is taken to have found
+#define STEP_US       300  // balance_step time given to period_step_done
+
+typedef struct {
+    int falls;
+    double interval_err;  // worst relative interval_time error after a switch
+    double peak_tilt;     // worst |tilt| after the push, deg
+} period_result_t;
+
+static int ticks_for(const sim_t* s, double seconds) {
+    return (int)(seconds * 1000 / s->config.period_ms);
+}
+
+/**
+ * Run for seconds, checking interval_time over the first CHECK_LOOPS loops if
+ * switched and keeping the peak tilt if measure. Returns 0 if the robot fell.
+ */
+static int run_for(sim_t* s, double seconds, int switched, int measure, period_result_t* res) {
+    double loop_s = s->config.period_ms / 1000.0;
+    int n = ticks_for(s, seconds);
+    for (int i = 0; i < n; i++) {
+        if (!sim_tick(s))
+            return 0;
+        // The first loop after a switch still ran at the old period
+        if (switched && i >= 1 && i <= CHECK_LOOPS) {
+            double err = fabs(interval_time - loop_s) / loop_s;
+            if (err > res->interval_err)
+                res->interval_err = err;
+        }
+        if (measure && fabs(sim_tilt_deg(s)) > res->peak_tilt)
+            res->peak_tilt = fabs(sim_tilt_deg(s));
+    }
+    return 1;
+}
+
+static void run(int wait_ms, int runs, period_result_t* res) {
+    sim_config_t config;
+    sim_default_config(&config);
+    memset(res, 0, sizeof(*res));
+
+    for (int r = 0; r < runs; r++) {
+        sim_t sim;
+        sim_init(&sim, &config, 0, r + 1);
+        int up = run_for(&sim, SETTLE_S, 0, 0, res);
+        if (up) {
+            sim_set_period(&sim, wait_ms);
+            up = run_for(&sim, PUSH_AFTER_S, 1, 0, res);
+        }
+        if (up) {
+            sim_push(&sim, r & 1 ? PUSH_DPS : -PUSH_DPS);
+            up = run_for(&sim, RUN_S / 2, 0, 1, res);
+        }
+        if (up && wait_ms < (int)WAIT_TIME_MS) {
+            sim_set_period(&sim, wait_ms + 1);
+            up = run_for(&sim, RUN_S / 2, 1, 1, res);
+        }
+        res->falls += !up;
+    }
+}
+
+typedef struct {
+    int falls;
+    int min_wait, max_wait;  // wait the runs end on, ms
+    int back_offs;
+    int stale_pct;           // largest period_info.stale_pct
+} adaptive_result_t;
+
+/**
+ * Run balance_task's loop for ADAPT_S with period.c choosing the wait, with
+ * the gyro updating every gyro_update_ms (0: every loop).
+ */
+static void run_adaptive(int gyro_update_ms, int runs, adaptive_result_t* res)
+{
+    sim_config_t config;
+    sim_default_config(&config);
+    config.gyro_update_ms = gyro_update_ms;
+    memset(res, 0, sizeof(*res));
+    res->min_wait = WAIT_TIME_MS;
+
+    for (int r = 0; r < runs; r++) {
+        sim_t sim;
+        sim_init(&sim, &config, 0, r + 1);
+        period_reset();
+        period_info.sensor_us = SENSOR_US;
+        gyro_reset(SENSOR_US);
+
+        int up = 1, wait_ms = 0;
+        uint32_t end_ms = sim.time_ms + (uint32_t)(ADAPT_S * 1000);
+        while (up && sim.time_ms < end_ms) {
+            up = sim_tick(&sim);
+            period_step_done(STEP_US);
+            sim.config.period_ms = balance_period_ms + STEP_TIME_MS;
+            // Only period_step_done backs off here
+            if (wait_ms != 0 && (int)period_info.wait_ms > wait_ms)
+                res->back_offs++;
+            wait_ms = period_info.wait_ms;
+            if (period_info.stale_pct > res->stale_pct)
+                res->stale_pct = period_info.stale_pct;
+        }
+        res->falls += !up;
+        if (wait_ms < res->min_wait)
+            res->min_wait = wait_ms;
+        if (wait_ms > res->max_wait)
+            res->max_wait = wait_ms;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int runs = 20;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            runs = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [-n runs]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    printf("%d runs each, switch after %.1f s, push %.0f deg/s %.1f s later\n",
+           runs, SETTLE_S, PUSH_DPS, PUSH_AFTER_S);
+    printf("wait ms   interval_time error   peak tilt   falls\n");
+    int failed = 0;
+    for (int wait_ms = WAIT_TIME_MS; wait_ms >= 1; wait_ms--) {
+        const char* note = wait_ms == (int)WAIT_TIME_MS ? "(stay)" : "";
+        period_result_t res;
+        run(wait_ms, runs, &res);
+        printf("%4d %-6s %19.1f%%   %7.2f deg   %5d\n", wait_ms, note,
+               res.interval_err * 100, res.peak_tilt, res.falls);
+        failed |= res.falls > 0;
+    }
+
+    printf("\nperiod.c choosing the wait for %.0f s, gyro taken to update every %d us\n",
+           ADAPT_S, SENSOR_US);
+    printf("gyro ms   end wait ms   back-offs   over baseline   falls\n");
+    static const int gyro_ms[] = { 0, 2, 3, 4, 6 };
+    for (int i = 0; i < (int)(sizeof(gyro_ms) / sizeof(gyro_ms[0])); i++) {
+        adaptive_result_t res;
+        run_adaptive(gyro_ms[i], runs, &res);
+        char name[8];
+        snprintf(name, sizeof(name), gyro_ms[i] ? "%d" : "loop", gyro_ms[i]);
+        printf("%7s %8d..%-4d %9d %14d%%   %5d\n", name, res.min_wait, res.max_wait,
+               res.back_offs, res.stale_pct, res.falls);
+        // A gyro that keeps up with the shortest loop should not back off at all
+        int loop_ms = res.min_wait + STEP_TIME_MS;
+        failed |= res.falls > 0 || loop_ms * 2 <= gyro_ms[i]
+            || (gyro_ms[i] <= PERIOD_MIN_MS + STEP_TIME_MS && res.back_offs > 0);
+    }
+    return failed;
+}
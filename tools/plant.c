@@ -0,0 +1,182 @@
+#include <math.h>
+#include "plant.h"
+
+#define GRAVITY 9.81
+#define RAD2DEG (180.0 / M_PI)
+
+void plant_default_params(plant_params_t* p)
+{
+    p->body_mass = 0.80;
+    p->body_height = 0.09;
+    p->wheel_mass = 0.03;
+    p->wheel_radius = 0.028;  // WHEEL_DIAMETER 5.6 cm
+    p->motor_inertia = 5e-4;  // rotor inertia seen through the gearbox
+    p->motor_resistance = 6.8;
+    p->motor_kt = 0.30;
+    p->motor_kb = 0.50;
+    p->motor_friction = 0.0022;
+    p->battery_voltage = 7.5;
+    p->track_width = 0.12;
+    p->body_depth = 0.06;
+    p->motor_imbalance = 0;
+    p->gun_inertia = 1e-4;    // spin-up then takes the medium motor's 0.08 N m stall torque
+    p->gun_speed = 25.3;      // 1450 deg/s
+    p->gun_time_constant = 0.03;
+}
+
+double plant_battery_gain(double battery_voltage)
+{
+    const double kMaxBattery = 8500;
+    const double kMinBattery = 6500;
+
+    return 0.7 + ((1.12 - 0.7) / (kMaxBattery - kMinBattery)) * (kMaxBattery - battery_voltage * 1000);
+}
+
+void plant_linearize(const plant_params_t* p, double A[PLANT_NX][PLANT_NX], double B[PLANT_NX])
+{
+    double M = p->body_mass, L = p->body_height;
+    double m = p->wheel_mass, R = p->wheel_radius;
+    double Jw = m * R * R / 2;
+    double Jpsi = M * L * L / 3;
+    double Jm = p->motor_inertia;
+    double alpha = p->motor_kt / p->motor_resistance;
+    double beta = p->motor_kt * p->motor_kb / p->motor_resistance + p->motor_friction;
+
+    // E q'' + F q' + G q = H v, q = { theta, psi }, v = voltage on each motor
+    double E11 = (2 * m + M) * R * R + 2 * Jw + 2 * Jm;
+    double E12 = M * L * R - 2 * Jm;
+    double E22 = M * L * L + Jpsi + 2 * Jm;
+    double F11 = 2 * beta, F12 = -2 * beta;
+    double F21 = -2 * beta, F22 = 2 * beta;
+    double G22 = -M * GRAVITY * L;
+    double H1 = 2 * alpha, H2 = -2 * alpha;
+
+    double det = E11 * E22 - E12 * E12;
+    double Ei11 = E22 / det, Ei12 = -E12 / det, Ei22 = E11 / det;
+
+    // Power (%) to motor voltage, including the battery gain applied in keep_balance
+    double volts_per_power = plant_battery_gain(p->battery_voltage) * p->battery_voltage / 100;
+
+    for (int i = 0; i < PLANT_NX; i++)
+        for (int j = 0; j < PLANT_NX; j++)
+            A[i][j] = 0;
+    A[0][2] = 1;
+    A[1][3] = 1;
+    A[2][1] = -Ei12 * G22;
+    A[3][1] = -Ei22 * G22;
+    A[2][2] = -(Ei11 * F11 + Ei12 * F21);
+    A[2][3] = -(Ei11 * F12 + Ei12 * F22);
+    A[3][2] = -(Ei12 * F11 + Ei22 * F21);
+    A[3][3] = -(Ei12 * F12 + Ei22 * F22);
+
+    B[0] = 0;
+    B[1] = 0;
+    B[2] = (Ei11 * H1 + Ei12 * H2) * volts_per_power;
+    B[3] = (Ei12 * H1 + Ei22 * H2) * volts_per_power;
+}
+
+void plant_sensor_transform(double T[PLANT_NX][PLANT_NX])
+{
+    // The encoders measure the wheel angle relative to the body: theta - psi
+    double t[PLANT_NX][PLANT_NX] = {
+        { 0,           0,            0,           RAD2DEG      },
+        { 0,           RAD2DEG,      0,           0            },
+        { 2 * RAD2DEG, -2 * RAD2DEG, 0,           0            },
+        { 0,           0,            2 * RAD2DEG, -2 * RAD2DEG },
+    };
+    for (int i = 0; i < PLANT_NX; i++)
+        for (int j = 0; j < PLANT_NX; j++)
+            T[i][j] = t[i][j];
+}
+
+void plant_to_sensors(const double x[PLANT_NX], double y[PLANT_NX])
+{
+    double T[PLANT_NX][PLANT_NX];
+    plant_sensor_transform(T);
+    for (int i = 0; i < PLANT_NX; i++) {
+        y[i] = 0;
+        for (int j = 0; j < PLANT_NX; j++)
+            y[i] += T[i][j] * x[j];
+    }
+}
+
+double plant_power_to_volts(const plant_params_t* p, int power)
+{
+    if (power > 100) power = 100;
+    if (power < -100) power = -100;
+    return power / 100.0 * p->battery_voltage;
+}
+
+/**
+ * Equations of motion, Yamamoto (2008) section 3 without the linearization.
+ */
+static void derivative(const plant_params_t* p, const plant_state_t* s, double vl, double vr, double gun_command,
+                       plant_state_t* d)
+{
+    double M = p->body_mass, L = p->body_height;
+    double m = p->wheel_mass, R = p->wheel_radius, W = p->track_width;
+    double Jw = m * R * R / 2;
+    double Jpsi = M * L * L / 3;
+    double Jphi = M * (W * W + p->body_depth * p->body_depth) / 12;
+    double Jm = p->motor_inertia;
+    double alpha = p->motor_kt / p->motor_resistance;
+    double beta = p->motor_kt * p->motor_kb / p->motor_resistance + p->motor_friction;
+    double tl = alpha * vl, tr = alpha * (1 + p->motor_imbalance) * vr;  // voltage term of each motor torque
+
+    double c = cos(s->psi), sn = sin(s->psi);
+    double E11 = (2 * m + M) * R * R + 2 * Jw + 2 * Jm;
+    double E12 = M * L * R * c - 2 * Jm;
+    double E22 = M * L * L + Jpsi + 2 * Jm;
+    double F_theta = (tl + tr) - 2 * beta * (s->theta_dot - s->psi_dot) + M * L * R * s->psi_dot * s->psi_dot * sn;
+    // The torque that spins the gun up or brakes it reacts on the body
+    double gun_ddot = (gun_command * p->gun_speed - s->gun_dot) / p->gun_time_constant;
+    double F_psi = -(tl + tr) + 2 * beta * (s->theta_dot - s->psi_dot) + M * GRAVITY * L * sn
+                   - p->gun_inertia * gun_ddot;
+
+    double det = E11 * E22 - E12 * E12;
+    d->theta = s->theta_dot;
+    d->psi = s->psi_dot;
+    d->theta_dot = (E22 * F_theta - E12 * F_psi) / det;
+    d->psi_dot = (E11 * F_psi - E12 * F_theta) / det;
+
+    // Yaw phi = R (theta_r - theta_l) / W = delta / k
+    double Jyaw = m * W * W / 2 + Jphi + W * W / (2 * R * R) * (Jw + Jm);
+    double k = W / (2 * R);
+    double phi_ddot = (k * (tr - tl) - W * W / (2 * R * R) * beta * s->delta_dot / k) / Jyaw;
+    d->delta = s->delta_dot;
+    d->delta_dot = k * phi_ddot;
+
+    d->gun = s->gun_dot;
+    d->gun_dot = gun_ddot;
+}
+
+static void axpy(plant_state_t* out, const plant_state_t* x, double a, const plant_state_t* d)
+{
+    out->theta = x->theta + a * d->theta;
+    out->psi = x->psi + a * d->psi;
+    out->delta = x->delta + a * d->delta;
+    out->theta_dot = x->theta_dot + a * d->theta_dot;
+    out->psi_dot = x->psi_dot + a * d->psi_dot;
+    out->delta_dot = x->delta_dot + a * d->delta_dot;
+    out->gun = x->gun + a * d->gun;
+    out->gun_dot = x->gun_dot + a * d->gun_dot;
+}
+
+void plant_step(const plant_params_t* p, plant_state_t* s, double left_volts, double right_volts,
+                double gun_command, double dt)
+{
+    plant_state_t k1, k2, k3, k4, tmp;
+
+    derivative(p, s, left_volts, right_volts, gun_command, &k1);
+    axpy(&tmp, s, dt / 2, &k1);
+    derivative(p, &tmp, left_volts, right_volts, gun_command, &k2);
+    axpy(&tmp, s, dt / 2, &k2);
+    derivative(p, &tmp, left_volts, right_volts, gun_command, &k3);
+    axpy(&tmp, s, dt, &k3);
+    derivative(p, &tmp, left_volts, right_volts, gun_command, &k4);
+
+    axpy(s, s, dt / 6, &k1);
+    axpy(s, s, dt / 3, &k2);
+    axpy(s, s, dt / 3, &k3);
+    axpy(s, s, dt / 6, &k4);
+}
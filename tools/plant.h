@@ -0,0 +1,76 @@
+#ifndef __PLANT_H__
+#define __PLANT_H__
+
+/**
+ * Model of the two-wheeled inverted pendulum robot driven by two EV3 large
+ * motors, after Yamamoto, "NXTway-GS Model-Based Design" (2008).
+ * Host only, used by the tools in this directory.
+ *
+ * Model state: { theta, psi, theta_dot, psi_dot }
+ * theta: mean wheel angle relative to the ground (rad)
+ * psi:   body pitch, positive leaning forward (rad)
+ */
+typedef struct {
+    double body_mass;         // kg, brick + motors + gun
+    double body_height;       // m, axle to centre of mass
+    double wheel_mass;        // kg, each wheel with tyre
+    double wheel_radius;      // m
+    double motor_inertia;     // kg m^2
+    double motor_resistance;  // ohm
+    double motor_kt;          // N m / A
+    double motor_kb;          // V s / rad
+    double motor_friction;    // N m s / rad, motor to body
+    double battery_voltage;   // V
+    double track_width;       // m, between the wheel centres
+    double body_depth;        // m, front to back, for the yaw inertia
+    double motor_imbalance;   // right motor torque constant relative to the left, minus 1
+    double gun_inertia;       // kg m^2, gun motor and shooter seen at the gun axle
+    double gun_speed;         // rad/s, gun at power 100
+    double gun_time_constant; // s, gun spin-up and braking
+} plant_params_t;
+
+/**
+ * Full nonlinear state. The wheels turn theta - delta (left) and theta + delta (right).
+ * The gun turns about an axis parallel to the wheel axle, gun relative to the body.
+ */
+typedef struct {
+    double theta, psi, delta, gun;                  // rad
+    double theta_dot, psi_dot, delta_dot, gun_dot;  // rad/s
+} plant_state_t;
+
+#define PLANT_NX 4
+
+void plant_default_params(plant_params_t* p);
+
+/**
+ * Linearize around upright: dx/dt = A x + B u.
+ * u is the pre-gain power returned by the controller (-100..100, before the
+ * battery gain that keep_balance applies), the same for both wheels.
+ */
+void plant_linearize(const plant_params_t* p, double A[PLANT_NX][PLANT_NX], double B[PLANT_NX]);
+
+/**
+ * Map the model state to what the controller sees:
+ * { gyro_speed (deg/s), gyro_angle (deg), motor_pos (deg, sum of both encoders), motor_speed (deg/s, sum) }
+ */
+void plant_to_sensors(const double x[PLANT_NX], double y[PLANT_NX]);
+void plant_sensor_transform(double T[PLANT_NX][PLANT_NX]);
+
+/**
+ * Advance the nonlinear model by dt seconds (RK4) with the given motor voltages.
+ * gun_command is the gun speed asked of the gun motor, -1..1 of gun_speed; 0 brakes it.
+ */
+void plant_step(const plant_params_t* p, plant_state_t* s, double left_volts, double right_volts,
+                double gun_command, double dt);
+
+/**
+ * Motor voltage for an ev3_motor_set_power value.
+ */
+double plant_power_to_volts(const plant_params_t* p, int power);
+
+/**
+ * Battery gain used by calculate_battery_gain() in app.c.
+ */
+double plant_battery_gain(double battery_voltage);
+
+#endif // __PLANT_H__
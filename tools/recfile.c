@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "ev3api.h"
+#include "gyro.h"
+#include "recorder.h"
+#include "recfile.h"
+
+/**
+ * Stands in for gyro.c: the robot's sample times are not recorded, so each
+ * sample is as fresh as the recording says it was.
+ */
+gyro_stats_t gyro_stats;
+static bool_t recorded_fresh = true;
+
+void gyro_reset(uint32_t interval_us) {
+    gyro_stats.samples = gyro_stats.stale = gyro_stats.repeats = 0;
+}
+
+bool_t gyro_sample(int* rate) {
+    *rate = ev3_gyro_sensor_get_rate(gyro_sensor);
+    gyro_stats.samples++;
+    if (!recorded_fresh)
+        gyro_stats.stale++;
+    return recorded_fresh;
+}
+
+balance_record_t* recfile_load(const char* path, size_t* count)
+{
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return NULL;
+    }
+
+    recorder_header_t header;
+    if (fread(&header, sizeof(header), 1, f) != 1 || header.magic != RECORDER_MAGIC ||
+        header.version != RECORDER_VERSION || header.record_size != sizeof(balance_record_t)) {
+        fprintf(stderr, "%s: not a version %d balance recording\n", path, RECORDER_VERSION);
+        fclose(f);
+        return NULL;
+    }
+
+    size_t capacity = 4096, n = 0;
+    balance_record_t* records = malloc(capacity * sizeof(balance_record_t));
+    while (records != NULL && fread(&records[n], sizeof(balance_record_t), 1, f) == 1) {
+        if (++n == capacity) {
+            capacity *= 2;
+            records = realloc(records, capacity * sizeof(balance_record_t));
+        }
+    }
+    fclose(f);
+    *count = n;
+    return records;
+}
+
+static void set_gains(const float* k)
+{
+    KGYROANGLE = k[0];
+    KGYROSPEED = k[1];
+    KPOS = k[2];
+    KSPEED = k[3];
+    KGUN = k[4];
+    balance_gains_changed();
+}
+
+void recfile_start(const balance_record_t* r)
+{
+    static float compiled[RECORD_NUM_GAINS];
+    static bool_t saved = false;
+    if (!saved) {
+        compiled[0] = KGYROANGLE;
+        compiled[1] = KGYROSPEED;
+        compiled[2] = KPOS;
+        compiled[3] = KSPEED;
+        compiled[4] = KGUN;
+        saved = true;
+    }
+    set_gains(compiled);
+
+    balance_reset();
+    gyro_offset = r->gyro_offset;
+    balance_start();
+}
+
+void recfile_gains(const balance_record_t* r)
+{
+    set_gains(r->gains);
+}
+
+bool_t recfile_step(const balance_record_t* r)
+{
+    ev3_stub.time = r->time;
+    ev3_stub.gyro_rate = r->gyro_rate;
+    ev3_stub.battery_mV = r->battery_mV;
+    ev3_stub.counts[left_motor] = r->left_cnt;
+    ev3_stub.counts[right_motor] = r->right_cnt;
+    ev3_stub.counts[gun_motor] = r->gun_cnt;
+    drive_target = r->drive_target;
+    steer_target = r->steer_target;
+    gun_direction = r->gun_direction;
+    gun_target = r->gun_target;
+    balance_set_period(r->period_ms);
+
+    recorded_fresh = !(r->flags & RECORD_STALE);
+    bool_t ok = balance_step();
+    recorded_fresh = true;
+    return ok;
+}
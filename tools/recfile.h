@@ -0,0 +1,35 @@
+#ifndef __RECFILE_H__
+#define __RECFILE_H__
+
+#include <stddef.h>
+#include "balance.h"
+
+/**
+ * Read a recording made with RECORD_BALANCE (recorder.h). Returns a malloc'd
+ * array of count records, or NULL after printing why.
+ */
+balance_record_t* recfile_load(const char* path, size_t* count);
+
+/**
+ * Start a run from its RECORD_START record, with the compiled gains until a
+ * RECORD_GAINS record says otherwise.
+ */
+void recfile_start(const balance_record_t* r);
+
+/**
+ * Use the gains of a RECORD_GAINS record from the next recfile_step on.
+ * Needs a TUNABLE_GAINS build of balance.c.
+ */
+void recfile_gains(const balance_record_t* r);
+
+/**
+ * Run balance_step on the inputs of a tick record as the robot did: the
+ * sensors, setpoints and gun state it read, at the period it ran, with the
+ * gyro sample as fresh as it was. Returns what balance_step returned.
+ *
+ * recfile.c stands in for gyro.c for this, so link it instead of gyro.o.
+ * Between recordings every sample is fresh.
+ */
+bool_t recfile_step(const balance_record_t* r);
+
+#endif // __RECFILE_H__
@@ -0,0 +1,119 @@
+/**
+ * Replay a recording made with RECORD_BALANCE through the unmodified
+ * balance_step (balance.c) and check that it sets the same motor power as
+ * the robot did, tick for tick.
+ *
+ * The build must use the same GAIN_PROFILE and controller as the robot.
+ * Gains changed with TUNABLE_GAINS are taken from the RECORD_GAINS records.
+ *
+ * Usage: replay [-n repeat] [-v] file.rec
+ * Exit status is 1 if any tick differs, so it can gate controller changes.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ev3api.h"
+#include "balance.h"
+#include "recfile.h"
+
+typedef struct {
+    long ticks;
+    long mismatches;
+    long skipped;     // ticks after a gap, until the next run starts
+    long runs;
+    double recorded_s;
+} replay_result_t;
+
+static void replay(const balance_record_t* records, size_t count, int verbose, replay_result_t* res)
+{
+    int in_run = 0;
+    SYSTIM run_start = 0, run_end = 0;
+
+    memset(res, 0, sizeof(*res));
+    for (size_t i = 0; i < count; i++) {
+        const balance_record_t* r = &records[i];
+
+        if (r->flags & RECORD_START) {
+            res->recorded_s += (run_end - run_start) / 1000.0;
+            recfile_start(r);
+            in_run = 1;
+            run_start = run_end = 0;
+            res->runs++;
+            continue;
+        }
+        if (r->flags & RECORD_GAINS) {
+            recfile_gains(r);
+            continue;
+        }
+        if (r->flags & RECORD_GAP)
+            in_run = 0;
+        if (!in_run) {
+            res->skipped++;
+            continue;
+        }
+
+        bool_t ok = recfile_step(r);
+        const balance_record_t* out = balance_last_record();
+
+        if (run_start == 0) run_start = r->time;
+        run_end = r->time;
+        res->ticks++;
+
+        if (out->left_power != r->left_power || out->right_power != r->right_power ||
+            (r->flags & RECORD_FALLEN) != (ok ? 0 : RECORD_FALLEN)) {
+            if (verbose && res->mismatches < 20)
+                printf("record %zu t=%u: robot L%d R%d%s, replay L%d R%d%s\n", i, r->time,
+                       r->left_power, r->right_power, (r->flags & RECORD_FALLEN) ? " fallen" : "",
+                       out->left_power, out->right_power, ok ? "" : " fallen");
+            res->mismatches++;
+        }
+        if (!ok)
+            in_run = 0;
+    }
+    res->recorded_s += (run_end - run_start) / 1000.0;
+}
+
+int main(int argc, char** argv)
+{
+    int repeat = 1, verbose = 0;
+    const char* path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc)
+            repeat = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-v"))
+            verbose = 1;
+        else if (path == NULL && argv[i][0] != '-')
+            path = argv[i];
+        else
+            path = NULL, i = argc;
+    }
+    if (path == NULL || repeat < 1) {
+        fprintf(stderr, "usage: %s [-n repeat] [-v] file.rec\n", argv[0]);
+        return 2;
+    }
+
+    size_t count;
+    balance_record_t* records = recfile_load(path, &count);
+    if (records == NULL)
+        return 2;
+
+    replay_result_t res;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int n = 0; n < repeat; n++)
+        replay(records, count, verbose && n == 0, &res);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    double elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("%ld runs, %ld ticks, %ld skipped after gaps, %ld mismatches\n",
+           res.runs, res.ticks, res.skipped, res.mismatches);
+    if (elapsed > 0 && res.ticks > 0)
+        printf("%.1f s recorded, replayed %d times in %.3f s (%.0fx real time, %.1f ns/tick)\n",
+               res.recorded_s, repeat, elapsed, res.recorded_s * repeat / elapsed,
+               elapsed * 1e9 / ((double)res.ticks * repeat));
+
+    free(records);
+    return res.mismatches ? 1 : 0;
+}
@@ -0,0 +1,140 @@
+#include <math.h>
+#include "ev3api.h"
+#include "balance.h"
+#include "sim.h"
+
+#define RAD2DEG (180.0 / M_PI)
+#define DEG2RAD (M_PI / 180.0)
+#define PLANT_DT 0.001
+
+void sim_default_config(sim_config_t* c)
+{
+    plant_default_params(&c->plant);
+    c->gyro_bias = 0.5;
+    c->gyro_noise = 1.0;
+    c->bias_drift = 0;
+    c->gyro_update_ms = 0;
+    c->period_ms = WAIT_TIME_MS + 1;
+    c->jitter_ms = 0;
+    c->floor_deg = 0;
+}
+
+double sim_random(sim_t* s)
+{
+    // xorshift32
+    s->rng ^= s->rng << 13;
+    s->rng ^= s->rng >> 17;
+    s->rng ^= s->rng << 5;
+    return s->rng / 4294967296.0;
+}
+
+void sim_init(sim_t* s, const sim_config_t* c, double tilt_deg, uint32_t seed)
+{
+    s->config = *c;
+    s->state = (plant_state_t){ 0 };
+    s->state.psi = tilt_deg * DEG2RAD;
+    s->time_ms = 1000;
+    s->gyro_time = 0;
+    s->rng = seed ? seed : 1;
+    s->bias = c->gyro_bias;
+    s->fallen = 0;
+    s->energy = 0;
+
+    for (int i = 0; i < TNUM_MOTOR_PORT; i++) {
+        ev3_stub.counts[i] = 0;
+        ev3_stub.power[i] = 0;
+        ev3_stub.rotate_speed[i] = 0;
+    }
+    gun_direction = 0;
+    gun_target = 0;
+    balance_reset();
+    gyro_offset = s->bias;
+    balance_start();
+}
+
+static void read_sensors(sim_t* s)
+{
+    const plant_state_t* x = &s->state;
+    int update_ms = s->config.gyro_update_ms;
+
+    ev3_stub.time = s->time_ms;
+    // A slower gyro holds its last sample until the next one on its own clock
+    if (update_ms == 0 || s->time_ms >= s->gyro_time) {
+        double rate = x->psi_dot * RAD2DEG + s->bias + (2 * sim_random(s) - 1) * s->config.gyro_noise;
+        ev3_stub.gyro_rate = (int16_t)lround(rate);
+        if (update_ms != 0)
+            s->gyro_time = s->time_ms - s->time_ms % update_ms + update_ms;
+    }
+    ev3_stub.battery_mV = (int)(s->config.plant.battery_voltage * 1000);
+    // The encoders turn with the wheel relative to the body
+    ev3_stub.counts[left_motor] = (int32_t)floor((x->theta - x->delta - x->psi) * RAD2DEG);
+    ev3_stub.counts[right_motor] = (int32_t)floor((x->theta + x->delta - x->psi) * RAD2DEG);
+    ev3_stub.counts[gun_motor] = (int32_t)floor(x->gun * RAD2DEG);
+}
+
+/**
+ * Gun command for the plant: run at the ev3_motor_rotate speed until the target, then brake.
+ */
+static double gun_command(const sim_t* s)
+{
+    int speed = ev3_stub.rotate_speed[gun_motor];
+    if (speed == 0)
+        return 0;
+    if ((speed > 0) == (s->state.gun * RAD2DEG >= ev3_stub.rotate_target[gun_motor])) {
+        ev3_stub.rotate_speed[gun_motor] = 0;
+        return 0;
+    }
+    return speed / 100.0;
+}
+
+int sim_tick(sim_t* s)
+{
+    if (s->fallen)
+        return 0;
+
+    read_sensors(s);
+    if (!balance_step()) {
+        s->fallen = 1;
+        return 0;
+    }
+
+    int period = s->config.period_ms;
+    if (s->config.jitter_ms > 0)
+        period += (int)(sim_random(s) * (s->config.jitter_ms + 1));
+
+    int lp = ev3_stub.power[left_motor], rp = ev3_stub.power[right_motor];
+    double vl = plant_power_to_volts(&s->config.plant, lp);
+    double vr = plant_power_to_volts(&s->config.plant, rp);
+    double floor = s->config.floor_deg * DEG2RAD;
+    for (int i = 0; i < period; i++) {
+        plant_step(&s->config.plant, &s->state, vl, vr, gun_command(s), PLANT_DT);
+        if (floor > 0 && fabs(s->state.psi) > floor) {
+            s->state.psi = copysign(floor, s->state.psi);
+            s->state.psi_dot = 0;
+        }
+    }
+
+    s->time_ms += period;
+    s->bias += s->config.bias_drift * period / 1000.0;
+    s->energy += (double)(lp * lp + rp * rp) * period / 1000.0;
+
+    if (s->config.floor_deg == 0 && fabs(sim_tilt_deg(s)) > SIM_FALL_ANGLE_DEG)
+        s->fallen = 1;
+    return !s->fallen;
+}
+
+void sim_set_period(sim_t* s, int wait_ms)
+{
+    s->config.period_ms = wait_ms + STEP_TIME_MS;
+    balance_set_period(wait_ms);
+}
+
+void sim_push(sim_t* s, double psi_dot_deg)
+{
+    s->state.psi_dot += psi_dot_deg * DEG2RAD;
+}
+
+double sim_tilt_deg(const sim_t* s)
+{
+    return s->state.psi * RAD2DEG;
+}
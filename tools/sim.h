@@ -0,0 +1,68 @@
+#ifndef __SIM_H__
+#define __SIM_H__
+
+#include <stdint.h>
+#include "plant.h"
+
+/**
+ * Closed loop of the real balance_step (balance.c, through host/ev3stub.c)
+ * and the nonlinear plant model. Host only.
+ *
+ * balance.c keeps its state in globals, so there is one simulation per
+ * process; the tuner runs candidates in parallel with forked workers.
+ */
+typedef struct {
+    plant_params_t plant;
+    double gyro_bias;     // deg/s, added to the gyro rate before rounding
+    double gyro_noise;    // deg/s, uniform +- noise on the gyro rate
+    double bias_drift;    // deg/s per second
+    int gyro_update_ms;   // 0: a new gyro sample every loop; else one every gyro_update_ms
+    int period_ms;        // loop period: balance_step plus tslp_tsk(WAIT_TIME_MS), see sim_set_period
+    int jitter_ms;        // extra 0..jitter_ms added to some periods
+    double floor_deg;     // 0: the run ends past SIM_FALL_ANGLE_DEG; else the body comes to rest at this tilt and the run goes on
+} sim_config_t;
+
+typedef struct {
+    sim_config_t config;
+    plant_state_t state;
+    uint32_t time_ms;
+    uint32_t gyro_time;   // time of the next gyro sample with gyro_update_ms
+    uint32_t rng;
+    double bias;
+    int fallen;
+    double energy;        // sum of power^2 * dt over both motors
+} sim_t;
+
+#define SIM_FALL_ANGLE_DEG 45.0
+
+void sim_default_config(sim_config_t* c);
+
+/**
+ * Reset balance.c and start a run with the body tilted by tilt_deg.
+ * The gyro is calibrated perfectly, as if the robot had been held still.
+ */
+void sim_init(sim_t* s, const sim_config_t* c, double tilt_deg, uint32_t seed);
+
+/**
+ * One control period: sensors to the stubs, balance_step, then the plant.
+ * The gun follows the last ev3_motor_rotate on gun_motor.
+ * Returns 0 once the robot has fallen (balance_step gave up or, without a floor,
+ * the body is past SIM_FALL_ANGLE_DEG).
+ */
+int sim_tick(sim_t* s);
+
+/**
+ * Change the wait mid-run as period.c does on the robot (balance_set_period):
+ * the loop becomes wait_ms plus STEP_TIME_MS.
+ */
+void sim_set_period(sim_t* s, int wait_ms);
+
+/**
+ * Kick the body with an instant change of pitch rate.
+ */
+void sim_push(sim_t* s, double psi_dot_deg);
+
+double sim_tilt_deg(const sim_t* s);
+double sim_random(sim_t* s); // uniform in [0, 1)
+
+#endif // __SIM_H__
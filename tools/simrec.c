@@ -0,0 +1,108 @@
+/**
+ * Make a recording as the robot does with RECORD_BALANCE, on the plant model,
+ * for tools/replay to check (make replay-check).
+ *
+ * balance_task's loop runs as built, with ADAPTIVE_PERIOD, through the real
+ * recorder.c, writing to simrec.rec. period.c chooses the wait, so the
+ * recording holds the WAIT_TIME_MS baseline and every switch after it. The
+ * gyro takes a new sample only every GYRO_UPDATE_MS, so some ticks are
+ * RECORD_STALE, and each run takes a push halfway.
+ *
+ * Built with TUNABLE_GAINS (simrec_tunable) it also changes the gains as
+ * gains.c would: slot A is loaded at boot with gains off the compiled ones,
+ * and the runs switch to slot B and back while balancing.
+ *
+ * Usage: simrec [-n runs]
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "ev3api.h"
+#include "balance.h"
+#include "gyro.h"
+#include "period.h"
+#include "recorder.h"
+#include "sim.h"
+#ifdef TUNABLE_GAINS
+#include "gains.h"
+#endif
+
+#define RUN_S           6.0
+#define PUSH_DPS        50.0
+#define GYRO_UPDATE_MS  4
+#define SENSOR_US       1000 // what period_probe is taken to have found, as in periodcheck
+#define STEP_US         300  // balance_step time given to period_step_done
+
+int main(int argc, char** argv)
+{
+    int runs = 4;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            runs = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [-n runs]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    sim_config_t config;
+    sim_default_config(&config);
+    config.gyro_update_ms = GYRO_UPDATE_MS;
+
+#ifdef TUNABLE_GAINS
+    gains_init();
+    gain_vector_t v;
+    gains_get(0, &v);
+    v.kgyrospeed *= 1.1f;
+    v.kpos *= 0.8f;
+    gains_set(0, &v);  // stands in for gains_load
+    gains_tick();
+    v.kgyroangle *= 1.2f;
+    v.kspeed *= 1.25f;
+    gains_set(1, &v);
+#endif
+
+    int ticks = 0, falls = 0;
+    for (int r = 0; r < runs; r++) {
+        sim_t sim;
+        sim_init(&sim, &config, 0, r + 1);
+        period_reset();
+        period_info.sensor_us = SENSOR_US;
+        gyro_reset(SENSOR_US);
+        recorder_start(gyro_offset);
+
+        uint32_t start_ms = sim.time_ms, run_ms = (uint32_t)(RUN_S * 1000);
+        int pushed = 0;
+#ifdef TUNABLE_GAINS
+        int switches = 0;
+#endif
+        while (sim.time_ms - start_ms < run_ms) {
+            uint32_t t = sim.time_ms - start_ms;
+#ifdef TUNABLE_GAINS
+            if (t >= run_ms * (switches + 1) / 3 && switches < 2) {
+                gains_select(1 - gains_active());
+                switches++;
+            }
+            if (gains_tick())
+                recorder_gains();
+#endif
+            if (t >= run_ms / 2 && !pushed) {
+                sim_push(&sim, r & 1 ? PUSH_DPS : -PUSH_DPS);
+                pushed = 1;
+            }
+            int up = sim_tick(&sim);
+            period_step_done(STEP_US);
+            sim.config.period_ms = balance_period_ms + STEP_TIME_MS;
+            recorder_push(balance_last_record());
+            recorder_flush();
+            ticks++;
+            if (!up) {
+                falls++;
+                break;
+            }
+        }
+    }
+
+    printf("%d runs, %d ticks, %d falls, %u dropped, written to %s\n",
+           runs, ticks, falls, recorder_dropped, RECORDER_PATH);
+    return 0;
+}
@@ -0,0 +1,308 @@
+/**
+ * Automatic tuning of KGYROSPEED, KGYROANGLE, KPOS and KSPEED.
+ *
+ * Every candidate gain vector runs the real balance_step (balance.c built
+ * with TUNABLE_GAINS) against the nonlinear plant model (sim.c) and is scored
+ * on:
+ *   settle     time until the tilt stays within 1 deg after a 50 deg/s push
+ *   overshoot  tilt past upright on the way back from that push
+ *   falls      fraction of runs lost under random pushes while driving
+ *   energy     mean sum of squared motor power per second in those runs
+ * Every candidate sees the same pushes and sensor noise. With -d both
+ * scores are taken while driving at a steady drive_target instead, to fit a
+ * point of the gain schedule (controller.c). -p 0 only scores the compiled-in
+ * gains; built with -DUSE_SCHEDULED_CONTROLLER, that is the schedule.
+ *
+ * Candidates come from a grid around the compiled-in gains, from 1 / GRID_SPAN
+ * to GRID_SPAN times each, in equal ratios. Every further pass centres a grid
+ * one step of the last one either side on the best candidate so far, within
+ * the first grid. A best gain on the edge of the first grid is reported: the
+ * model would take it further than GRID_SPAN allows. Candidates are
+ * spread over one forked worker per CPU (balance.c keeps its state in
+ * globals, so it cannot run twice in one process). Workers claim small
+ * chunks from a shared counter, so a worker that finishes early takes over
+ * the rest of the grid.
+ *
+ * Usage: tuner [-s steps_per_gain] [-p passes] [-d drive] [-j workers] [-n top]
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "ev3api.h"
+#include "balance.h"
+#include "sim.h"
+
+#define NUM_TUNED 4
+#define CHUNK 4
+#define GRID_SPAN 3.0
+
+#define PUSH_RUNS  8
+#define PUSH_RUN_S 6.0
+
+static int drive = -1;  // steady drive_target for -d, -1 for the default scenario
+
+typedef struct {
+    float k[NUM_TUNED];   // KGYROSPEED, KGYROANGLE, KPOS, KSPEED
+    double settle_s;
+    double overshoot_deg;
+    double fall_rate;
+    double energy;
+    double score;
+} candidate_t;
+
+typedef struct {
+    volatile long next;
+    long count;
+    candidate_t candidates[];
+} shared_t;
+
+static const char* gain_names[NUM_TUNED] = { "KGYROSPEED", "KGYROANGLE", "KPOS", "KSPEED" };
+
+static void set_gains(const float k[NUM_TUNED]) {
+    KGYROSPEED = k[0];
+    KGYROANGLE = k[1];
+    KPOS = k[2];
+    KSPEED = k[3];
+}
+
+static int ticks(double seconds, const sim_config_t* c) {
+    return (int)(seconds * 1000 / c->period_ms);
+}
+
+/**
+ * Stand (or drive) for 1 s, push forward at 50 deg/s and watch for 4 s.
+ */
+static void score_push_response(candidate_t* cand, const sim_config_t* config) {
+    sim_t sim;
+    sim_init(&sim, config, 0, 12345);
+    drive_target = drive < 0 ? 0 : drive;
+
+    for (int i = 0; i < ticks(1.0, config); i++)
+        if (!sim_tick(&sim)) goto fell;
+
+    sim_push(&sim, 50);
+    int n = ticks(4.0, config), last_out = 0, crossed = 0;
+    double overshoot = 0;
+    for (int i = 0; i < n; i++) {
+        if (!sim_tick(&sim)) goto fell;
+        double tilt = sim_tilt_deg(&sim);
+        if (fabs(tilt) > 1.0) last_out = i + 1;
+        if (tilt < 0) crossed = 1;
+        if (crossed && -tilt > overshoot) overshoot = -tilt;
+    }
+    cand->settle_s = last_out * config->period_ms / 1000.0;
+    cand->overshoot_deg = overshoot;
+    return;
+
+fell:
+    cand->settle_s = 4.0;
+    cand->overshoot_deg = SIM_FALL_ANGLE_DEG;
+}
+
+/**
+ * Random pushes of up to 80 deg/s every 0.5 to 1.5 s while the drive target steps around, or holds with -d.
+ */
+static void score_disturbances(candidate_t* cand, const sim_config_t* config) {
+    static const int drive_steps[] = { 0, 300, 0, -300 };
+    int falls = 0;
+    double energy = 0, seconds = 0;
+
+    for (int run = 0; run < PUSH_RUNS; run++) {
+        sim_t sim;
+        sim_init(&sim, config, 0, 1000 + run);
+        int n = ticks(PUSH_RUN_S, config);
+        int next_push = ticks(0.5 + sim_random(&sim), config);
+        int i;
+        for (i = 0; i < n; i++) {
+            drive_target = drive < 0 ? drive_steps[(i / ticks(2.0, config)) % 4] : drive;
+            if (i == next_push) {
+                sim_push(&sim, (2 * sim_random(&sim) - 1) * 80);
+                next_push += ticks(0.5 + sim_random(&sim), config);
+            }
+            if (!sim_tick(&sim)) {
+                falls++;
+                break;
+            }
+        }
+        energy += sim.energy;
+        seconds += i * config->period_ms / 1000.0;
+    }
+    cand->fall_rate = (double)falls / PUSH_RUNS;
+    cand->energy = seconds > 0 ? energy / seconds : 0;
+}
+
+static void evaluate(candidate_t* cand, const sim_config_t* config) {
+    set_gains(cand->k);
+    score_push_response(cand, config);
+    score_disturbances(cand, config);
+    cand->score = cand->settle_s + 0.2 * cand->overshoot_deg + 5 * cand->fall_rate + cand->energy / 20000;
+}
+
+static void worker(shared_t* shared, const sim_config_t* config) {
+    long i;
+    while ((i = __atomic_fetch_add(&shared->next, CHUNK, __ATOMIC_RELAXED)) < shared->count) {
+        long end = i + CHUNK < shared->count ? i + CHUNK : shared->count;
+        for (; i < end; i++)
+            evaluate(&shared->candidates[i], config);
+    }
+}
+
+static int compare_score(const void* a, const void* b) {
+    double x = ((const candidate_t*)a)->score, y = ((const candidate_t*)b)->score;
+    return (x > y) - (x < y);
+}
+
+static void print_header() {
+    printf("rank   %6s %6s %6s %6s | %7s %9s %5s %7s | %6s\n", "GYSPD", "GYANG", "KPOS", "KSPD",
+           "settle", "overshoot", "falls", "energy", "score");
+}
+
+static void print_candidate(const char* label, const candidate_t* c) {
+    printf("%-6s %6.3f %6.2f %6.4f %6.4f | %5.2f s %5.2f deg %4.0f%% %7.0f | %6.3f\n", label,
+           c->k[0], c->k[1], c->k[2], c->k[3], c->settle_s, c->overshoot_deg, c->fall_rate * 100, c->energy, c->score);
+}
+
+/**
+ * Fill the grid of steps values per gain from centre / span to centre * span,
+ * moved inside lo and hi if it sticks out.
+ */
+static void fill_grid(shared_t* shared, int steps, const float centre[NUM_TUNED], double span,
+                      const float lo[NUM_TUNED], const float hi[NUM_TUNED]) {
+    double first[NUM_TUNED];
+    for (int g = 0; g < NUM_TUNED; g++) {
+        first[g] = centre[g] / span;
+        if (first[g] < lo[g])
+            first[g] = lo[g];
+        if (first[g] * span * span > hi[g])
+            first[g] = hi[g] / (span * span);
+    }
+    for (long i = 0; i < shared->count; i++) {
+        long idx = i;
+        for (int g = 0; g < NUM_TUNED; g++) {
+            shared->candidates[i].k[g] = first[g] * pow(span, 2.0 * (idx % steps) / (steps - 1));
+            idx /= steps;
+        }
+    }
+    shared->next = 0;
+}
+
+static void run_workers(shared_t* shared, long workers, const sim_config_t* config) {
+    for (long w = 0; w < workers; w++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            worker(shared, config);
+            _exit(0);
+        } else if (pid < 0) {
+            perror("fork");
+            break;
+        }
+    }
+    while (wait(NULL) > 0)
+        ;
+}
+
+int main(int argc, char** argv) {
+    int steps = 6, passes = 3, top = 10;
+    long workers = sysconf(_SC_NPROCESSORS_ONLN);
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-s") && i + 1 < argc)
+            steps = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-p") && i + 1 < argc)
+            passes = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-d") && i + 1 < argc)
+            drive = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-j") && i + 1 < argc)
+            workers = atol(argv[++i]);
+        else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+            top = atoi(argv[++i]);
+        else
+            steps = 0, i = argc;
+    }
+    if (steps < 2 || passes < 0 || drive > MAX_SPEED || workers < 1 || top < 1) {
+        fprintf(stderr, "usage: %s [-s steps_per_gain (>= 2)] [-p passes] [-d drive (0..%d)] [-j workers] [-n top]\n",
+                argv[0], MAX_SPEED);
+        return 2;
+    }
+
+    sim_config_t config;
+    sim_default_config(&config);
+
+    long count = 1;
+    for (int g = 0; g < NUM_TUNED; g++) count *= steps;
+
+    size_t size = sizeof(shared_t) + count * sizeof(candidate_t);
+    shared_t* shared = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    shared->count = count;
+
+    // The compiled-in profile, for reference
+    candidate_t current = { { KGYROSPEED, KGYROANGLE, KPOS, KSPEED } };
+    evaluate(&current, &config);
+    if (passes == 0) {
+        print_header();
+        print_candidate("now", &current);
+        return 0;
+    }
+
+    // Gains are positive, the grid keeps their sign
+    float centre[NUM_TUNED], lo[NUM_TUNED], hi[NUM_TUNED];
+    for (int g = 0; g < NUM_TUNED; g++) {
+        centre[g] = current.k[g];
+        lo[g] = current.k[g] / GRID_SPAN;
+        hi[g] = current.k[g] * GRID_SPAN;
+    }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    candidate_t best = current;
+    double span = GRID_SPAN;
+    for (int pass = 0; pass < passes; pass++) {
+        fill_grid(shared, steps, centre, span, lo, hi);
+        run_workers(shared, workers, &config);
+        qsort(shared->candidates, count, sizeof(candidate_t), compare_score);
+        if (pass == 0 || shared->candidates[0].score < best.score)
+            best = shared->candidates[0];
+        for (int g = 0; g < NUM_TUNED; g++)
+            centre[g] = best.k[g];
+        span = pow(span, 2.0 / (steps - 1));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    double elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("%d passes of %ld candidates on %ld workers in %.1f s\n\n", passes, count, workers, elapsed);
+    print_header();
+    print_candidate("now", &current);
+    for (int i = 0; i < top && i < count; i++) {
+        char label[12];
+        sprintf(label, "%d", i + 1);
+        print_candidate(label, &shared->candidates[i]);
+    }
+
+    print_candidate("best", &best);
+
+    for (int g = 0; g < NUM_TUNED; g++)
+        if (best.k[g] <= lo[g] * 1.0001f || best.k[g] >= hi[g] * 0.9999f)
+            printf("warning: %s is on the edge of the grid, %gx the compiled-in gain\n", gain_names[g],
+                   best.k[g] <= lo[g] * 1.0001f ? 1 / GRID_SPAN : GRID_SPAN);
+
+    if (drive >= 0) {
+        printf("\n/* tools/tuner -s %d -p %d -d %d: paste into gain_schedule in controller.c */\n", steps, passes, drive);
+        printf("{ %5.1ff, { %.4ff, %.4ff, %.4ff, %.4ff, 1.0f } },\n", (float)drive, best.k[0] / current.k[0],
+               best.k[1] / current.k[1], best.k[2] / current.k[2], best.k[3] / current.k[3]);
+    } else {
+        printf("\n/* tools/tuner -s %d -p %d: paste into the gain profile in balance.c */\n", steps, passes);
+        for (int g = 0; g < NUM_TUNED; g++)
+            printf("TUNABLE_GAIN %s = %.4ff;\n", gain_names[g], best.k[g]);
+    }
+
+    munmap(shared, size);
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include "ev3api.h"
+#include "balance.h"
+#include "period.h"
+#include "watchdog.h"
+
+static const char* level_names[TNUM_LOAD_LEVEL] = { "full", "no eyes", "no telemetry", "slow IR" };
+
+volatile load_level_t load_level = LOAD_FULL;
+uint32_t watchdog_misses;
+uint32_t watchdog_worst_ms;
+
+static bool_t started;
+static SYSTIM last_tick, last_change;
+static int window_ticks, window_misses, quiet_windows;
+static uint32_t window_worst_ms;
+
+static void set_level(load_level_t level, SYSTIM now) {
+    syslog(LOG_NOTICE, "Watchdog: %s -> %s, %d misses in %d loops, worst %d ms, %d ms since last change.",
+           level_names[load_level], level_names[level], window_misses, window_ticks,
+           (int)window_worst_ms, (int)(now - last_change));
+    load_level = level;
+    last_change = now;
+}
+
+void watchdog_reset() {
+    started = false;
+    watchdog_misses = 0;
+    watchdog_worst_ms = 0;
+    window_ticks = window_misses = quiet_windows = 0;
+    window_worst_ms = 0;
+}
+
+void watchdog_tick(SYSTIM now) {
+    if (!started) {
+        started = true;
+        last_tick = last_change = now;
+        return;
+    }
+
+    uint32_t period = now - last_tick;
+    last_tick = now;
+    if (period > balance_period_ms + STEP_TIME_MS + WATCHDOG_LATE_MS) {
+        watchdog_misses++;
+        window_misses++;
+    }
+    if (period > watchdog_worst_ms)
+        watchdog_worst_ms = period;
+    if (period > window_worst_ms)
+        window_worst_ms = period;
+
+    if (++window_ticks < WATCHDOG_WINDOW)
+        return;
+
+    if (window_misses >= SHED_MISSES) {
+        quiet_windows = 0;
+        // A period shorter than WAIT_TIME_MS is given up before any work is shed
+        if (!period_back_off() && load_level < TNUM_LOAD_LEVEL - 1)
+            set_level(load_level + 1, now);
+    } else if (window_misses == 0 && load_level > LOAD_FULL) {
+        if (++quiet_windows >= RESTORE_WINDOWS) {
+            quiet_windows = 0;
+            set_level(load_level - 1, now);
+        }
+    } else {
+        quiet_windows = 0;
+    }
+    window_ticks = window_misses = 0;
+    window_worst_ms = 0;
+}
@@ -0,0 +1,49 @@
+#ifndef __WATCHDOG_H__
+#define __WATCHDOG_H__
+
+#include "ev3api.h"
+
+/**
+ * Overrun watchdog for balance_task.
+ *
+ * balance_task calls watchdog_tick once per loop. A loop is due the wait
+ * (balance_period_ms) plus STEP_TIME_MS for balance_step after the last one,
+ * and one that starts more than WATCHDOG_LATE_MS after that is a deadline
+ * miss. Every WATCHDOG_WINDOW loops, SHED_MISSES misses or more first back
+ * the period off towards WAIT_TIME_MS (period.h), then shed one more stage of
+ * the non-critical work, and RESTORE_WINDOWS windows in a row without a miss
+ * give one back. The other tasks check load_level before doing that work.
+ * Each transition is logged with the misses and the worst period seen.
+ */
+#define WATCHDOG_LATE_MS  3
+#define WATCHDOG_WINDOW   100  // loops, 0.6 s at a 5 ms wait
+#define SHED_MISSES       5
+#define RESTORE_WINDOWS   4
+
+typedef enum {
+    LOAD_FULL,          // everything runs
+    LOAD_NO_EYES,       // no eye animation or LCD status
+    LOAD_NO_TELEMETRY,  // recordings are buffered but not flushed
+    LOAD_SLOW_IR,       // the IR remote is polled less often
+    TNUM_LOAD_LEVEL
+} load_level_t;
+
+extern volatile load_level_t load_level;
+
+/**
+ * Deadline misses and the longest loop period (ms) since watchdog_reset.
+ */
+extern uint32_t watchdog_misses;
+extern uint32_t watchdog_worst_ms;
+
+/**
+ * Start watching a new run. Keeps the current load level.
+ */
+void watchdog_reset();
+
+/**
+ * Call at the top of every balance_task loop.
+ */
+void watchdog_tick(SYSTIM now);
+
+#endif // __WATCHDOG_H__